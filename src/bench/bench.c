@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Microbenchmarks for hp-wmi.c against the emulated BIOS
+ *
+ * The driver is built into this file, so the benchmarks call its sysfs
+ * handlers and notify handler directly. Work items run whenever a
+ * benchmark drains the queue, every -B operations, which stands in for
+ * the worker getting scheduled that often.
+ */
+#include <getopt.h>
+
+#include "hp-wmi.c"
+#include "fake_bios.h"
+
+static unsigned int iterations = 1000;
+static unsigned int burst = 1;
+
+struct bench_result {
+  u64 calls;
+  u64 ns;
+  u64 busy_ns;
+};
+
+static void bench_begin(struct bench_result *r)
+{
+  bench_run_work();
+  r->calls = fake_bios_calls();
+  r->busy_ns = fake_bios_busy_ns();
+  r->ns = ktime_get_ns();
+}
+
+static void bench_end(struct bench_result *r, const char *name,
+          unsigned int ops, const char *unit, u64 count)
+{
+  bench_run_work();
+  r->ns = ktime_get_ns() - r->ns;
+  r->calls = fake_bios_calls() - r->calls;
+  r->busy_ns = fake_bios_busy_ns() - r->busy_ns;
+
+  printf("%-12s %8u ops %8.3f calls/op %10.0f ns/op %10.0f %s/s  (%.1f%% in firmware)\n",
+         name, ops, (double)r->calls / ops, (double)r->ns / ops,
+         r->ns ? count * 1e9 / r->ns : 0.0, unit,
+         r->ns ? 100.0 * r->busy_ns / r->ns : 0.0);
+}
+
+/* Writes one zone per operation, cycling through colours and zones */
+static void bench_zone_write(void)
+{
+  static const char * const colors[] = { "FF0000", "00FF00", "0000FF", "FFFFFF" };
+  struct device *dev = &hp_wmi_platform_dev->dev;
+  struct bench_result r;
+  unsigned int i;
+
+  bench_begin(&r);
+  for (i = 0; i < iterations; i++) {
+    zone_set(dev, &zone_dev_attrs[i % FOURZONE_COUNT],
+       colors[(i / FOURZONE_COUNT) % ARRAY_SIZE(colors)], 7);
+    if ((i + 1) % burst == 0)
+      bench_run_work();
+  }
+  bench_end(&r, "zone_write", iterations, "writes", iterations);
+}
+
+static void bench_zone_show(void)
+{
+  struct device *dev = &hp_wmi_platform_dev->dev;
+  struct bench_result r;
+  char buf[PAGE_SIZE];
+  unsigned int i;
+
+  bench_begin(&r);
+  for (i = 0; i < iterations; i++)
+    zone_show(dev, &zone_dev_attrs[i % FOURZONE_COUNT], buf);
+  bench_end(&r, "zone_show", iterations, "reads", iterations);
+}
+
+/* Omen key presses, from WMI notify to the input report */
+static void bench_notify(void)
+{
+  struct bench_result r;
+  unsigned int i;
+  u64 events;
+
+  events = bench_input_events;
+  bench_begin(&r);
+  for (i = 0; i < iterations; i++) {
+    fake_bios_push_hotkey(0x21A5);
+    fake_bios_fire_event(HPWMI_BEZEL_BUTTON, 0);
+    if ((i + 1) % burst == 0)
+      bench_run_work();
+  }
+  bench_run_work();
+  events = bench_input_events - events;
+  bench_end(&r, "notify", iterations, "events", events);
+
+  if (events != iterations)
+    fprintf(stderr, "notify: %llu of %u key presses reached input\n",
+      (unsigned long long)events, iterations);
+}
+
+static const struct {
+  const char *name;
+  void (*run)(void);
+} benchmarks[] = {
+  { "zone_write", bench_zone_write },
+  { "zone_show", bench_zone_show },
+  { "notify", bench_notify },
+};
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+    "usage: %s [-n iterations] [-B burst] [-l call_us] [-b byte_ns] [-j jitter_us] [benchmark...]\n"
+    "benchmarks: zone_write zone_show notify (default: all)\n",
+    prog);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  struct fake_bios_latency latency = { .call_ns = 100 * NSEC_PER_USEC };
+  int opt, err, i, j;
+
+  while ((opt = getopt(argc, argv, "n:B:l:b:j:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = strtoul(optarg, NULL, 0);
+      break;
+    case 'B':
+      burst = strtoul(optarg, NULL, 0);
+      break;
+    case 'l':
+      latency.call_ns = strtoull(optarg, NULL, 0) * NSEC_PER_USEC;
+      break;
+    case 'b':
+      latency.byte_ns = strtoull(optarg, NULL, 0);
+      break;
+    case 'j':
+      latency.jitter_ns = strtoull(optarg, NULL, 0) * NSEC_PER_USEC;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (!iterations || !burst)
+    usage(argv[0]);
+
+  fake_bios_reset();
+  fake_bios_set_latency(&latency);
+
+  err = bench_module_init();
+  if (err) {
+    fprintf(stderr, "module init failed: %d\n", err);
+    return 1;
+  }
+  bench_run_work();
+
+  if (!hp_wmi_platform_dev || !zone_data) {
+    fprintf(stderr, "FourZone lighting did not probe\n");
+    return 1;
+  }
+
+  printf("latency: %llu ns/call + %llu ns/byte + up to %llu ns jitter, burst %u\n",
+         (unsigned long long)latency.call_ns,
+         (unsigned long long)latency.byte_ns,
+         (unsigned long long)latency.jitter_ns, burst);
+
+  for (i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+    if (optind == argc) {
+      benchmarks[i].run();
+      continue;
+    }
+    for (j = optind; j < argc; j++)
+      if (!strcmp(argv[j], benchmarks[i].name))
+        benchmarks[i].run();
+  }
+
+  bench_module_exit();
+  return 0;
+}
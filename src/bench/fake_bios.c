@@ -0,0 +1,445 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Emulated HP WMI BIOS
+ *
+ * Speaks the bios_args/bios_return protocol of hp-wmi.c on the BIOS
+ * GUID and serves events on the event GUID. The layouts are restated
+ * here rather than shared, so a driver-side layout change shows up as a
+ * failing benchmark instead of being mirrored silently.
+ */
+#include "fake_bios.h"
+
+#define HPWMI_EVENT_GUID "95F24279-4D7B-4334-9387-ACCDC67EF61C"
+#define HPWMI_BIOS_GUID "5FB7F034-2C63-45e9-BE91-3D44E2C707E4"
+
+#define BIOS_SIGNATURE 0x55434553
+
+/* Commands, and their slot in the unsupported bitmap */
+enum {
+  CMD_READ,
+  CMD_WRITE,
+  CMD_ODM,
+  CMD_GM,
+  CMD_FOURZONE,
+  CMD_COUNT,
+};
+
+static const u32 command_ids[CMD_COUNT] = {
+  [CMD_READ] = 0x01,
+  [CMD_WRITE] = 0x02,
+  [CMD_ODM] = 0x03,
+  [CMD_GM] = 0x20008,
+  [CMD_FOURZONE] = 131081,
+};
+
+enum {
+  RET_OK = 0x00,
+  RET_WRONG_SIGNATURE = 0x02,
+  RET_UNKNOWN_COMMAND = 0x03,
+  RET_UNKNOWN_CMDTYPE = 0x04,
+  RET_INPUT_DATA_INVALID = 0x07,
+};
+
+/* Output sizes selected by the WMI method id */
+static const int method_outsize[] = { 0, 0, 4, 128, 1024, 4096 };
+
+struct args {
+  u32 signature;
+  u32 command;
+  u32 commandtype;
+  u32 datasize;
+  u8 data[];
+};
+
+struct ret {
+  u32 sigpass;
+  u32 return_code;
+  u8 data[];
+};
+
+#define RING_SIZE 64
+
+static struct {
+  struct fake_bios_latency latency;
+  u64 calls;
+  u64 busy_ns;
+  DECLARE_BITMAP(unsupported, CMD_COUNT * 256);
+
+  u8 fourzone[FAKE_BIOS_FOURZONE_SIZE];
+  u8 fourzone_anim[FAKE_BIOS_FOURZONE_SIZE];
+  u8 brightness;
+  u32 wireless;
+  u32 hotkeys[RING_SIZE];
+  unsigned int hotkey_in, hotkey_out;
+  struct { u32 id, data; } events[RING_SIZE];
+  unsigned int event_in, event_out;
+
+  u8 fan_rpm[2];
+  u8 cpu_temp;
+  u8 gpu_temp;
+  u8 design_data[8];
+  u8 thermal_code;
+  u32 fan_max;
+  u8 gpu_modes[4];
+  u8 power_limits[4];
+
+  wmi_notify_handler notify;
+  void *notify_context;
+} bios;
+
+void fake_bios_reset(void)
+{
+  int i;
+
+  bios.calls = 0;
+  memset(bios.unsupported, 0, sizeof(bios.unsupported));
+  bios.busy_ns = 0;
+
+  for (i = 0; i < FAKE_BIOS_FOURZONE_SIZE; i++)
+    bios.fourzone[i] = i;
+  memset(bios.fourzone_anim, 0, sizeof(bios.fourzone_anim));
+  bios.brightness = 0xE4;
+  /* wifi and bluetooth present, neither blocked */
+  bios.wireless = 0x3 | 0xa00 | (0xa00 << 8);
+  bios.hotkey_in = bios.hotkey_out = 0;
+  bios.event_in = bios.event_out = 0;
+
+  bios.fan_rpm[0] = 25;
+  bios.fan_rpm[1] = 27;
+  bios.cpu_temp = 48;
+  bios.gpu_temp = 52;
+  memset(bios.design_data, 0, sizeof(bios.design_data));
+  bios.design_data[5] = 90;
+  bios.thermal_code = 0;
+  bios.fan_max = 0;
+  memset(bios.gpu_modes, 0, sizeof(bios.gpu_modes));
+  memset(bios.power_limits, 0, sizeof(bios.power_limits));
+
+  /* rfkill2 is left to the older WIRELESS_QUERY */
+  fake_bios_set_unsupported(command_ids[CMD_READ], 0x1b);
+  fake_bios_set_unsupported(command_ids[CMD_WRITE], 0x1b);
+}
+
+void fake_bios_set_latency(const struct fake_bios_latency *latency)
+{
+  bios.latency = *latency;
+}
+
+static int command_slot(u32 command)
+{
+  int i;
+
+  for (i = 0; i < CMD_COUNT; i++)
+    if (command_ids[i] == command)
+      return i;
+  return -1;
+}
+
+void fake_bios_set_unsupported(u32 command, u32 commandtype)
+{
+  int slot = command_slot(command);
+
+  if (slot >= 0 && commandtype < 256)
+    __set_bit(slot * 256 + commandtype, bios.unsupported);
+}
+
+void fake_bios_push_hotkey(u32 code)
+{
+  if (bios.hotkey_in - bios.hotkey_out < RING_SIZE)
+    bios.hotkeys[bios.hotkey_in++ % RING_SIZE] = code;
+}
+
+bool fake_bios_fire_event(u32 event_id, u32 event_data)
+{
+  if (!bios.notify)
+    return false;
+
+  if (bios.event_in - bios.event_out < RING_SIZE) {
+    bios.events[bios.event_in % RING_SIZE].id = event_id;
+    bios.events[bios.event_in % RING_SIZE].data = event_data;
+    bios.event_in++;
+  }
+  bios.notify(0x80, bios.notify_context);
+  return true;
+}
+
+u64 fake_bios_calls(void)
+{
+  return bios.calls;
+}
+
+u64 fake_bios_busy_ns(void)
+{
+  return bios.busy_ns;
+}
+
+static void spin_latency(size_t bytes)
+{
+  u64 cost = bios.latency.call_ns + bios.latency.byte_ns * bytes;
+  u64 start, end;
+
+  if (bios.latency.jitter_ns)
+    cost += (u64)rand() % (bios.latency.jitter_ns + 1);
+  if (!cost)
+    return;
+
+  start = ktime_get_ns();
+  do
+    end = ktime_get_ns();
+  while (end - start < cost);
+  bios.busy_ns += end - start;
+}
+
+static u32 read_u32(const u8 *data, u32 size)
+{
+  u32 value = 0;
+
+  memcpy(&value, data, min_t(u32, size, sizeof(value)));
+  return value;
+}
+
+static void write_u32(u8 *out, u32 value)
+{
+  memcpy(out, &value, sizeof(value));
+}
+
+static int do_read(u32 type, u8 *out)
+{
+  switch (type) {
+  case 0x01: /* display */
+    write_u32(out, 1);
+    return RET_OK;
+  case 0x02: /* hddtemp */
+  case 0x03: /* als */
+  case 0x04: /* hardware: undocked, laptop mode */
+  case 0x2a: /* postcode */
+    write_u32(out, 0);
+    return RET_OK;
+  case 0x05:
+    write_u32(out, bios.wireless);
+    return RET_OK;
+  case 0x0b: /* feature */
+  case 0x0d: /* feature2 */
+    return RET_OK;
+  case 0x0c:
+    if (bios.hotkey_in == bios.hotkey_out)
+      write_u32(out, 0);
+    else
+      write_u32(out, bios.hotkeys[bios.hotkey_out++ % RING_SIZE]);
+    return RET_OK;
+  }
+  return RET_UNKNOWN_CMDTYPE;
+}
+
+static int do_write(u32 type, const u8 *in, u32 insize)
+{
+  u32 value = read_u32(in, insize);
+  int r;
+
+  switch (type) {
+  case 0x05:
+    /* Bit 8 + r selects radio r, bit r is its new soft state */
+    for (r = 0; r < 3; r++) {
+      if (!(value & BIT(r + 8)))
+        continue;
+      if (value & BIT(r))
+        bios.wireless |= 0x200 << (r * 8);
+      else
+        bios.wireless &= ~(0x200 << (r * 8));
+    }
+    return RET_OK;
+  case 0x03: /* als */
+  case 0x09: /* bios: enable hotkeys */
+  case 0x2a: /* postcode */
+    return RET_OK;
+  }
+  return RET_UNKNOWN_CMDTYPE;
+}
+
+static int do_gm(u32 type, const u8 *in, u32 insize, u8 *out)
+{
+  switch (type) {
+  case 0x1a:
+    if (insize < 2)
+      return RET_INPUT_DATA_INVALID;
+    bios.thermal_code = in[1];
+    return RET_OK;
+  case 0x21:
+    memcpy(out, bios.gpu_modes, sizeof(bios.gpu_modes));
+    return RET_OK;
+  case 0x22:
+    memcpy(bios.gpu_modes, in, min_t(u32, insize, sizeof(bios.gpu_modes)));
+    return RET_OK;
+  case 0x23:
+    out[0] = bios.cpu_temp;
+    return RET_OK;
+  case 0x26:
+    write_u32(out, bios.fan_max);
+    return RET_OK;
+  case 0x27:
+    bios.fan_max = read_u32(in, insize);
+    return RET_OK;
+  case 0x28:
+    memcpy(out, bios.design_data, sizeof(bios.design_data));
+    return RET_OK;
+  case 0x29:
+    memcpy(bios.power_limits, in,
+           min_t(u32, insize, sizeof(bios.power_limits)));
+    return RET_OK;
+  case 0x2d:
+    memcpy(out, bios.fan_rpm, sizeof(bios.fan_rpm));
+    return RET_OK;
+  }
+  return RET_UNKNOWN_CMDTYPE;
+}
+
+static int do_fourzone(u32 type, const u8 *in, u32 insize, u8 *out)
+{
+  switch (type) {
+  case 2:
+    memcpy(out, bios.fourzone, FAKE_BIOS_FOURZONE_SIZE);
+    return RET_OK;
+  case 3:
+    memcpy(bios.fourzone, in, min_t(u32, insize, FAKE_BIOS_FOURZONE_SIZE));
+    return RET_OK;
+  case 4:
+    out[0] = bios.brightness;
+    return RET_OK;
+  case 5:
+    if (!insize)
+      return RET_INPUT_DATA_INVALID;
+    bios.brightness = in[0];
+    return RET_OK;
+  case 6:
+    memcpy(out, bios.fourzone_anim, FAKE_BIOS_FOURZONE_SIZE);
+    return RET_OK;
+  case 7:
+    memcpy(bios.fourzone_anim, in,
+           min_t(u32, insize, FAKE_BIOS_FOURZONE_SIZE));
+    return RET_OK;
+  }
+  return RET_UNKNOWN_CMDTYPE;
+}
+
+bool wmi_has_guid(const char *guid)
+{
+  return !strcmp(guid, HPWMI_BIOS_GUID) || !strcmp(guid, HPWMI_EVENT_GUID);
+}
+
+/*
+ * Fills the caller's buffer like ACPICA does: the object header first,
+ * its data right behind it.
+ */
+static acpi_status return_buffer(struct acpi_buffer *out, const void *data,
+         u32 length)
+{
+  union acpi_object *obj;
+  size_t needed = sizeof(*obj) + length;
+
+  if (out->length == ACPI_ALLOCATE_BUFFER) {
+    out->pointer = malloc(needed);
+    if (!out->pointer)
+      return AE_NOT_FOUND;
+  } else if (out->length < needed) {
+    out->length = needed;
+    return AE_BUFFER_OVERFLOW;
+  }
+
+  out->length = needed;
+  obj = out->pointer;
+  obj->buffer.type = ACPI_TYPE_BUFFER;
+  obj->buffer.length = length;
+  obj->buffer.pointer = (u8 *)(obj + 1);
+  memcpy(obj->buffer.pointer, data, length);
+  return AE_OK;
+}
+
+acpi_status wmi_evaluate_method(const char *guid, u8 instance, u32 method_id,
+        const struct acpi_buffer *in, struct acpi_buffer *out)
+{
+  static u8 reply[sizeof(struct ret) + 4096];
+  const struct args *args = in->pointer;
+  struct ret *ret = (struct ret *)reply;
+  u32 insize, outsize;
+  int slot;
+
+  if (strcmp(guid, HPWMI_BIOS_GUID) ||
+      method_id >= ARRAY_SIZE(method_outsize) ||
+      in->length < sizeof(*args))
+    return AE_NOT_FOUND;
+
+  insize = min_t(u32, args->datasize, in->length - sizeof(*args));
+  outsize = method_outsize[method_id];
+  memset(reply, 0, sizeof(*ret) + outsize);
+
+  slot = command_slot(args->command);
+  bios.calls++;
+
+  if (args->signature != BIOS_SIGNATURE)
+    ret->return_code = RET_WRONG_SIGNATURE;
+  else if (slot < 0)
+    ret->return_code = RET_UNKNOWN_COMMAND;
+  else if (args->commandtype >= 256 ||
+     test_bit(slot * 256 + args->commandtype, bios.unsupported))
+    ret->return_code = RET_UNKNOWN_CMDTYPE;
+  else if (slot == CMD_READ)
+    ret->return_code = do_read(args->commandtype, ret->data);
+  else if (slot == CMD_WRITE)
+    ret->return_code = do_write(args->commandtype, args->data, insize);
+  else if (slot == CMD_GM)
+    ret->return_code = do_gm(args->commandtype, args->data, insize,
+           ret->data);
+  else if (slot == CMD_FOURZONE)
+    ret->return_code = do_fourzone(args->commandtype, args->data, insize,
+                 ret->data);
+  else
+    ret->return_code = RET_UNKNOWN_CMDTYPE;
+
+  spin_latency(insize + outsize);
+
+  return return_buffer(out, reply, sizeof(*ret) + outsize);
+}
+
+acpi_status wmi_get_event_data(u32 event, struct acpi_buffer *out)
+{
+  u32 data[2];
+
+  if (bios.event_in == bios.event_out)
+    return AE_NOT_FOUND;
+
+  data[0] = bios.events[bios.event_out % RING_SIZE].id;
+  data[1] = bios.events[bios.event_out % RING_SIZE].data;
+  bios.event_out++;
+  return return_buffer(out, data, sizeof(data));
+}
+
+acpi_status wmi_install_notify_handler(const char *guid,
+               wmi_notify_handler handler, void *data)
+{
+  if (strcmp(guid, HPWMI_EVENT_GUID))
+    return AE_NOT_FOUND;
+  bios.notify = handler;
+  bios.notify_context = data;
+  return AE_OK;
+}
+
+acpi_status wmi_remove_notify_handler(const char *guid)
+{
+  bios.notify = NULL;
+  return AE_OK;
+}
+
+/* Only the thermal profile (0x95) and GPU temperature (0xB7) registers are backed */
+int ec_read(u8 addr, u8 *val)
+{
+  switch (addr) {
+  case 0x95:
+    *val = bios.thermal_code;
+    return 0;
+  case 0xB7:
+    *val = bios.gpu_temp;
+    return 0;
+  default:
+    return -EIO;
+  }
+}
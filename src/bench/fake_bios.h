@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Emulated HP WMI BIOS for the userspace harness
+ */
+#ifndef _BENCH_FAKE_BIOS_H
+#define _BENCH_FAKE_BIOS_H
+
+#include "kernel.h"
+
+/*
+ * Every wmi_evaluate_method() call spins for
+ *   call_ns + byte_ns * (input + output bytes) + rand() % (jitter_ns + 1)
+ * to stand in for the SMI round trip of a real BIOS.
+ */
+struct fake_bios_latency {
+  u64 call_ns;
+  u64 byte_ns;
+  u64 jitter_ns;
+};
+
+#define FAKE_BIOS_FOURZONE_SIZE 128
+
+void fake_bios_reset(void);
+void fake_bios_set_latency(const struct fake_bios_latency *latency);
+
+/* Marks one commandtype of a command as unknown to the firmware */
+void fake_bios_set_unsupported(u32 command, u32 commandtype);
+
+/* Queues a hotkey code for the next HOTKEY_QUERY */
+void fake_bios_push_hotkey(u32 code);
+
+/*
+ * Queues one event for wmi_get_event_data() and calls the installed
+ * notify handler. Returns false if no handler is installed.
+ */
+bool fake_bios_fire_event(u32 event_id, u32 event_data);
+
+/* Method calls since the last reset */
+u64 fake_bios_calls(void);
+/* Time spent in the latency model since the last reset */
+u64 fake_bios_busy_ns(void);
+
+#endif /* _BENCH_FAKE_BIOS_H */
@@ -0,0 +1,461 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Userspace implementation of the kernel API in kernel.h
+ */
+#include <ctype.h>
+#include <time.h>
+
+#include "kernel.h"
+
+int printk(const char *fmt, ...)
+{
+  static int verbose = -1;
+  va_list args;
+  int ret;
+
+  if (verbose < 0)
+    verbose = getenv("HP_WMI_BENCH_VERBOSE") != NULL;
+  if (!verbose)
+    return 0;
+
+  va_start(args, fmt);
+  ret = vfprintf(stderr, fmt, args);
+  va_end(args);
+  return ret;
+}
+
+u64 ktime_get_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* strings */
+
+int kstrtoul(const char *s, unsigned int base, unsigned long *res)
+{
+  unsigned long value;
+  char *end;
+
+  if (*s == '+')
+    s++;
+  if (!isxdigit((unsigned char)*s))
+    return -EINVAL;
+  errno = 0;
+  value = strtoul(s, &end, base);
+  if (errno)
+    return -ERANGE;
+  if (*end == '\n')
+    end++;
+  if (*end)
+    return -EINVAL;
+  *res = value;
+  return 0;
+}
+
+int kstrtouint(const char *s, unsigned int base, unsigned int *res)
+{
+  unsigned long value;
+  int ret = kstrtoul(s, base, &value);
+
+  if (ret)
+    return ret;
+  if (value > UINT32_MAX)
+    return -ERANGE;
+  *res = value;
+  return 0;
+}
+
+int kstrtou8(const char *s, unsigned int base, u8 *res)
+{
+  unsigned long value;
+  int ret = kstrtoul(s, base, &value);
+
+  if (ret)
+    return ret;
+  if (value > U8_MAX)
+    return -ERANGE;
+  *res = value;
+  return 0;
+}
+
+int kstrtobool(const char *s, bool *res)
+{
+  switch (s[0]) {
+  case 'y': case 'Y': case '1':
+    *res = true;
+    return 0;
+  case 'n': case 'N': case '0':
+    *res = false;
+    return 0;
+  case 'o': case 'O':
+    if (s[1] == 'n' || s[1] == 'N') {
+      *res = true;
+      return 0;
+    }
+    if (s[1] == 'f' || s[1] == 'F') {
+      *res = false;
+      return 0;
+    }
+    break;
+  }
+  return -EINVAL;
+}
+
+unsigned long simple_strtoul(const char *s, char **end, unsigned int base)
+{
+  return strtoul(s, end, base);
+}
+
+static bool sysfs_streq(const char *s1, const char *s2)
+{
+  while (*s1 && *s1 == *s2) {
+    s1++;
+    s2++;
+  }
+  if (*s1 == *s2)
+    return true;
+  if (!*s1 && *s2 == '\n' && !s2[1])
+    return true;
+  if (*s1 == '\n' && !s1[1] && !*s2)
+    return true;
+  return false;
+}
+
+int __sysfs_match_string(const char * const *array, size_t n, const char *s)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    if (array[i] && sysfs_streq(array[i], s))
+      return i;
+  return -EINVAL;
+}
+
+/* work items */
+
+static struct workqueue_struct bench_system_wq = { "events" };
+static struct workqueue_struct bench_freezable_wq = { "events_freezable" };
+struct workqueue_struct *system_wq = &bench_system_wq;
+struct workqueue_struct *system_freezable_wq = &bench_freezable_wq;
+
+static struct work_struct *run_head, **run_tail = &run_head;
+static struct delayed_work *timers;
+
+struct workqueue_struct *alloc_ordered_workqueue(const char *fmt,
+             unsigned int flags, ...)
+{
+  struct workqueue_struct *wq = calloc(1, sizeof(*wq));
+
+  if (wq)
+    wq->name = fmt;
+  return wq;
+}
+
+void destroy_workqueue(struct workqueue_struct *wq)
+{
+  free(wq);
+}
+
+static void run_queue_add(struct work_struct *work)
+{
+  work->next = NULL;
+  *run_tail = work;
+  run_tail = &work->next;
+}
+
+static bool run_queue_del(struct work_struct *work)
+{
+  struct work_struct **p;
+
+  for (p = &run_head; *p; p = &(*p)->next) {
+    if (*p != work)
+      continue;
+    *p = work->next;
+    if (run_tail == &work->next)
+      run_tail = p;
+    return true;
+  }
+  return false;
+}
+
+static bool timer_del(struct delayed_work *dwork)
+{
+  struct delayed_work **p;
+
+  for (p = &timers; *p; p = &(*p)->timer_next) {
+    if (*p != dwork)
+      continue;
+    *p = dwork->timer_next;
+    dwork->timer = false;
+    return true;
+  }
+  return false;
+}
+
+static void timer_add(struct delayed_work *dwork, unsigned long delay)
+{
+  dwork->timer = true;
+  dwork->expires = jiffies + delay;
+  dwork->timer_next = timers;
+  timers = dwork;
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+  if (work->pending)
+    return false;
+  work->pending = true;
+  run_queue_add(work);
+  return true;
+}
+
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+      unsigned long delay)
+{
+  if (dwork->work.pending)
+    return false;
+  if (!delay)
+    return queue_work(wq, &dwork->work);
+  dwork->work.pending = true;
+  timer_add(dwork, delay);
+  return true;
+}
+
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+          unsigned long delay)
+{
+  bool pending = cancel_delayed_work(dwork);
+
+  queue_delayed_work(wq, dwork, delay);
+  return pending;
+}
+
+static void run_one(struct work_struct *work)
+{
+  work->pending = false;
+  work->func(work);
+}
+
+bool flush_work(struct work_struct *work)
+{
+  if (!work->pending || !run_queue_del(work))
+    return false;
+  run_one(work);
+  return true;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+  bool pending = work->pending;
+
+  run_queue_del(work);
+  work->pending = false;
+  return pending;
+}
+
+bool cancel_delayed_work(struct delayed_work *dwork)
+{
+  timer_del(dwork);
+  return cancel_work_sync(&dwork->work);
+}
+
+unsigned int bench_run_work(void)
+{
+  struct delayed_work **p, *dwork;
+  struct work_struct *work;
+  unsigned int count = 0;
+
+  for (;;) {
+    for (p = &timers; (dwork = *p);) {
+      if (time_before(jiffies, dwork->expires)) {
+        p = &dwork->timer_next;
+        continue;
+      }
+      *p = dwork->timer_next;
+      dwork->timer = false;
+      run_queue_add(&dwork->work);
+    }
+
+    work = run_head;
+    if (!work)
+      return count;
+    run_queue_del(work);
+    run_one(work);
+    count++;
+  }
+}
+
+/* driver model */
+
+struct platform_driver *bench_platform_driver;
+
+int sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp)
+{
+  return 0;
+}
+
+void sysfs_remove_group(struct kobject *kobj, const struct attribute_group *grp)
+{
+}
+
+int platform_driver_register(struct platform_driver *drv)
+{
+  bench_platform_driver = drv;
+  return 0;
+}
+
+void platform_driver_unregister(struct platform_driver *drv)
+{
+  bench_platform_driver = NULL;
+}
+
+struct platform_device *platform_device_register_simple(const char *name, int id,
+              const void *res, unsigned int num)
+{
+  struct platform_device *pdev = calloc(1, sizeof(*pdev));
+  int err;
+
+  if (!pdev)
+    return ERR_PTR(-ENOMEM);
+  pdev->name = name;
+  pdev->id = id;
+  pdev->dev.name = name;
+
+  if (bench_platform_driver) {
+    err = bench_platform_driver->probe(pdev);
+    if (err) {
+      free(pdev);
+      return ERR_PTR(err);
+    }
+  }
+  return pdev;
+}
+
+void platform_device_unregister(struct platform_device *pdev)
+{
+  if (bench_platform_driver)
+    bench_platform_driver->remove(pdev);
+  free(pdev);
+}
+
+/* input */
+
+u64 bench_input_events;
+
+struct input_dev *input_allocate_device(void)
+{
+  return calloc(1, sizeof(struct input_dev));
+}
+
+void input_free_device(struct input_dev *dev)
+{
+  free(dev);
+}
+
+int input_register_device(struct input_dev *dev)
+{
+  return 0;
+}
+
+void input_unregister_device(struct input_dev *dev)
+{
+  free(dev);
+}
+
+void input_report_switch(struct input_dev *dev, unsigned int code, int value)
+{
+  bench_input_events++;
+}
+
+int sparse_keymap_setup(struct input_dev *dev, const struct key_entry *keymap,
+      void *setup)
+{
+  dev->keymap = keymap;
+  return 0;
+}
+
+bool sparse_keymap_report_event(struct input_dev *dev, unsigned int code,
+        unsigned int value, bool autorelease)
+{
+  const struct key_entry *key;
+
+  for (key = dev->keymap; key->type != KE_END; key++) {
+    if (key->code == code) {
+      bench_input_events++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* everything else */
+
+struct rfkill {
+  const struct rfkill_ops *ops;
+  void *data;
+};
+
+struct rfkill *rfkill_alloc(const char *name, struct device *parent,
+          enum rfkill_type type, const struct rfkill_ops *ops,
+          void *data)
+{
+  struct rfkill *rfkill = calloc(1, sizeof(*rfkill));
+
+  if (rfkill) {
+    rfkill->ops = ops;
+    rfkill->data = data;
+  }
+  return rfkill;
+}
+
+void rfkill_destroy(struct rfkill *rfkill)
+{
+  free(rfkill);
+}
+
+static int bench_dentry;
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+  return (struct dentry *)&bench_dentry;
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+           struct dentry *parent, void *data,
+           const struct file_operations *fops)
+{
+  return (struct dentry *)&bench_dentry;
+}
+
+int led_mc_calc_color_components(struct led_classdev_mc *mc,
+         enum led_brightness brightness)
+{
+  unsigned int i;
+
+  for (i = 0; i < mc->num_colors; i++)
+    mc->subled_info[i].brightness = brightness *
+      mc->subled_info[i].intensity / mc->led_cdev.max_brightness;
+  return 0;
+}
+
+struct device *hwmon_device_register_with_info(struct device *dev,
+                 const char *name, void *drvdata,
+                 const struct hwmon_chip_info *info,
+                 const void *extra_groups)
+{
+  struct device *hwmon = calloc(1, sizeof(*hwmon));
+
+  if (!hwmon)
+    return ERR_PTR(-ENOMEM);
+  hwmon->parent = dev;
+  hwmon->name = name;
+  return hwmon;
+}
+
+void hwmon_device_unregister(struct device *dev)
+{
+  free(dev);
+}
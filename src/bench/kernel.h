@@ -0,0 +1,727 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Just enough of the kernel API to build hp-wmi.c as a userspace program.
+ *
+ * Everything runs on one thread: locks are no-ops, work items run when
+ * the harness drains the queue (or when the driver flushes them), and
+ * async stages run inline. Firmware calls go to fake_bios.c.
+ */
+#ifndef _BENCH_KERNEL_H
+#define _BENCH_KERNEL_H
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef s32 __s32;
+typedef s64 __s64;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+typedef unsigned int __poll_t;
+typedef s64 ktime_t;
+typedef u32 acpi_status;
+typedef u64 acpi_size;
+
+#define KBUILD_MODNAME "hp_wmi"
+
+#define __init
+#define __exit
+#define __initconst
+#define __user
+#define __packed __attribute__((packed))
+#define __maybe_unused __attribute__((unused))
+#define fallthrough __attribute__((fallthrough))
+
+#define ERESTARTSYS 512
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 1
+
+#define BIT(n) (1UL << (n))
+#define BITS_PER_LONG 64
+#define BITS_TO_LONGS(n) (((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define READ_ONCE(x) (*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, v) (*(volatile typeof(x) *)&(x) = (v))
+#define WARN_ON(c) ({ \
+  int __c = !!(c); \
+  if (__c) \
+    fprintf(stderr, "WARNING at %s:%d\n", __FILE__, __LINE__); \
+  __c; })
+#define WARN_ON_ONCE(c) WARN_ON(c)
+#define BUILD_BUG_ON(c) _Static_assert(!(c), #c)
+
+#define min(a, b) ({ typeof(a) __a = (a); typeof(b) __b = (b); __a < __b ? __a : __b; })
+#define max(a, b) ({ typeof(a) __a = (a); typeof(b) __b = (b); __a > __b ? __a : __b; })
+#define min_t(t, a, b) min((t)(a), (t)(b))
+#define max_t(t, a, b) max((t)(a), (t)(b))
+#define clamp_val(v, lo, hi) min(max(v, (typeof(v))(lo)), (typeof(v))(hi))
+#define rounddown(x, y) ((x) - ((x) % (y)))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
+#define IS_ERR(p) ((unsigned long)(p) >= (unsigned long)-4095)
+#define PTR_ERR(p) ((long)(p))
+#define ERR_PTR(e) ((void *)(long)(e))
+
+#define xchg(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+
+#define U8_MAX 0xff
+#define PAGE_SIZE 4096
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1UL))
+#define MSEC_PER_SEC 1000L
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC 1000000000L
+#define HZ 1000
+
+/* printk goes to stderr when HP_WMI_BENCH_VERBOSE is set */
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define pr_err(fmt, ...) printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_warn(fmt, ...) printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_info(fmt, ...) printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_debug(fmt, ...) do { } while (0)
+#define pr_warn_once pr_warn
+#define pr_warn_ratelimited pr_warn
+#define pr_info_ratelimited pr_info
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_ALIAS(x)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define module_param_named(name, var, type, perm)
+#define module_param_array_named(name, var, type, nump, perm)
+#define module_init(fn) int (*const bench_module_init)(void) = fn
+#define module_exit(fn) void (*const bench_module_exit)(void) = fn
+#define THIS_MODULE NULL
+
+/* memory */
+static inline void *kmalloc(size_t size, gfp_t gfp) { return malloc(size); }
+static inline void *kzalloc(size_t size, gfp_t gfp) { return calloc(1, size); }
+static inline void *kcalloc(size_t n, size_t size, gfp_t gfp) { return calloc(n, size); }
+static inline void kfree(const void *p) { free((void *)p); }
+static inline char *kstrdup(const char *s, gfp_t gfp) { return s ? strdup(s) : NULL; }
+static inline char *kstrndup(const char *s, size_t n, gfp_t gfp) { return s ? strndup(s, n) : NULL; }
+static inline void *vmalloc_user(unsigned long size) { return calloc(1, size); }
+static inline void vfree(const void *p) { free((void *)p); }
+
+/* strings */
+int kstrtoul(const char *s, unsigned int base, unsigned long *res);
+int kstrtouint(const char *s, unsigned int base, unsigned int *res);
+int kstrtou8(const char *s, unsigned int base, u8 *res);
+int kstrtobool(const char *s, bool *res);
+unsigned long simple_strtoul(const char *s, char **end, unsigned int base);
+int __sysfs_match_string(const char * const *array, size_t n, const char *s);
+#define sysfs_match_string(a, s) __sysfs_match_string(a, ARRAY_SIZE(a), s)
+
+/* time: jiffies are milliseconds of CLOCK_MONOTONIC */
+u64 ktime_get_ns(void);
+static inline ktime_t ktime_get(void) { return ktime_get_ns(); }
+static inline ktime_t ktime_sub(ktime_t a, ktime_t b) { return a - b; }
+static inline s64 ktime_to_ns(ktime_t t) { return t; }
+#define jiffies ((unsigned long)(ktime_get_ns() / NSEC_PER_MSEC))
+static inline unsigned long msecs_to_jiffies(unsigned int ms) { return ms; }
+static inline unsigned long nsecs_to_jiffies(u64 ns) { return ns / NSEC_PER_MSEC; }
+#define time_before(a, b) ((long)((a) - (b)) < 0)
+#define time_after(a, b) time_before(b, a)
+
+static inline u64 div_u64(u64 a, u32 b) { return a / b; }
+static inline u64 div64_u64(u64 a, u64 b) { return a / b; }
+static inline u64 div64_u64_rem(u64 a, u64 b, u64 *rem) { *rem = a % b; return a / b; }
+#define ilog2(n) (63 - __builtin_clzll(n))
+
+/* bitops */
+static inline bool test_bit(long nr, const unsigned long *addr)
+{
+  return addr[nr / BITS_PER_LONG] & BIT(nr % BITS_PER_LONG);
+}
+static inline void __set_bit(long nr, unsigned long *addr)
+{
+  addr[nr / BITS_PER_LONG] |= BIT(nr % BITS_PER_LONG);
+}
+#define set_bit __set_bit
+static inline unsigned long __find_next_bit(const unsigned long *addr,
+              unsigned long size, unsigned long nr)
+{
+  while (nr < size && !test_bit(nr, addr))
+    nr++;
+  return nr;
+}
+#define for_each_set_bit(bit, addr, size) \
+  for ((bit) = __find_next_bit((const unsigned long *)(addr), size, 0); \
+       (bit) < (size); \
+       (bit) = __find_next_bit((const unsigned long *)(addr), size, (bit) + 1))
+
+typedef struct { long counter; } atomic_long_t;
+#define ATOMIC_LONG_INIT(i) { (i) }
+static inline void atomic_long_inc(atomic_long_t *v) { v->counter++; }
+static inline long atomic_long_read(const atomic_long_t *v) { return v->counter; }
+
+/* locking: one thread, so only the interfaces */
+struct mutex { int held; };
+typedef struct { int held; } spinlock_t;
+struct rw_semaphore { int readers; int writer; };
+typedef struct { unsigned int sequence; } seqlock_t;
+
+#define DEFINE_MUTEX(name) struct mutex name = { 0 }
+#define DEFINE_SPINLOCK(name) spinlock_t name = { 0 }
+#define DECLARE_RWSEM(name) struct rw_semaphore name = { 0 }
+#define lockdep_assert_held(l) ((void)(l))
+
+static inline void mutex_init(struct mutex *m) { m->held = 0; }
+static inline void mutex_lock(struct mutex *m) { m->held++; }
+static inline int mutex_lock_interruptible(struct mutex *m) { m->held++; return 0; }
+static inline void mutex_unlock(struct mutex *m) { m->held--; }
+static inline void spin_lock(spinlock_t *l) { l->held++; }
+static inline void spin_unlock(spinlock_t *l) { l->held--; }
+#define spin_lock_irqsave(l, flags) do { (flags) = 0; spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, flags) do { (void)(flags); spin_unlock(l); } while (0)
+static inline void down_read(struct rw_semaphore *s) { s->readers++; }
+static inline void up_read(struct rw_semaphore *s) { s->readers--; }
+static inline void down_write(struct rw_semaphore *s) { s->writer++; }
+static inline void up_write(struct rw_semaphore *s) { s->writer--; }
+static inline void downgrade_write(struct rw_semaphore *s) { s->writer--; s->readers++; }
+static inline void seqlock_init(seqlock_t *s) { s->sequence = 0; }
+static inline unsigned int read_seqbegin(const seqlock_t *s) { return s->sequence; }
+static inline int read_seqretry(const seqlock_t *s, unsigned int seq) { return s->sequence != seq; }
+static inline void write_seqlock(seqlock_t *s) { s->sequence++; }
+static inline void write_sequnlock(seqlock_t *s) { s->sequence++; }
+
+/* lists */
+struct list_head { struct list_head *next, *prev; };
+#define LIST_HEAD(name) struct list_head name = { &(name), &(name) }
+static inline void list_add_tail(struct list_head *n, struct list_head *head)
+{
+  n->prev = head->prev;
+  n->next = head;
+  head->prev->next = n;
+  head->prev = n;
+}
+static inline void list_del(struct list_head *n)
+{
+  n->prev->next = n->next;
+  n->next->prev = n->prev;
+}
+#define list_for_each_entry(pos, head, member) \
+  for (pos = container_of((head)->next, typeof(*pos), member); \
+       &pos->member != (head); \
+       pos = container_of(pos->member.next, typeof(*pos), member))
+
+/* wait queues never block: the harness only polls */
+typedef struct { int unused; } wait_queue_head_t;
+#define DECLARE_WAIT_QUEUE_HEAD(name) wait_queue_head_t name = { 0 }
+static inline void wake_up_interruptible(wait_queue_head_t *wq) { }
+#define wait_event_interruptible(wq, cond) ((cond) ? 0 : -ERESTARTSYS)
+
+/* kfifo, fixed size only */
+#define DECLARE_KFIFO(name, type, size) \
+  struct { unsigned int in, out; type buf[size]; } name
+#define DEFINE_KFIFO(name, type, size) DECLARE_KFIFO(name, type, size) = { 0 }
+#define INIT_KFIFO(fifo) ((fifo).in = (fifo).out = 0)
+#define kfifo_size(fifo) ARRAY_SIZE((fifo)->buf)
+#define kfifo_len(fifo) ((fifo)->in - (fifo)->out)
+#define kfifo_is_empty(fifo) ((fifo)->in == (fifo)->out)
+#define kfifo_is_full(fifo) (kfifo_len(fifo) >= kfifo_size(fifo))
+#define kfifo_put(fifo, val) ({ \
+  typeof(fifo) __f = (fifo); \
+  int __ok = !kfifo_is_full(__f); \
+  if (__ok) \
+    __f->buf[__f->in++ % kfifo_size(__f)] = (val); \
+  __ok; })
+#define kfifo_get(fifo, ptr) ({ \
+  typeof(fifo) __f = (fifo); \
+  int __ok = !kfifo_is_empty(__f); \
+  if (__ok) \
+    *(ptr) = __f->buf[__f->out++ % kfifo_size(__f)]; \
+  __ok; })
+#define kfifo_in_spinlocked(fifo, ptr, n, lock) ({ \
+  unsigned int __i = 0; \
+  spin_lock(lock); \
+  while (__i < (n) && kfifo_put(fifo, (ptr)[__i])) \
+    __i++; \
+  spin_unlock(lock); \
+  __i; })
+#define kfifo_to_user(fifo, to, len, copied) ({ \
+  typeof(fifo) __f = (fifo); \
+  typeof(__f->buf[0]) *__to = (void *)(to); \
+  unsigned int __n = 0; \
+  while (__n < (len) / sizeof(*__to) && kfifo_get(__f, &__to[__n])) \
+    __n++; \
+  *(copied) = __n * sizeof(*__to); \
+  0; })
+
+/*
+ * Work items. Queued work runs from bench_run_work() or when the driver
+ * flushes it; delayed work becomes runnable once its timer expires.
+ */
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+struct work_struct {
+  work_func_t func;
+  bool pending;
+  struct work_struct *next;
+};
+struct delayed_work {
+  struct work_struct work;
+  bool timer;
+  unsigned long expires;
+  struct delayed_work *timer_next;
+};
+struct workqueue_struct { const char *name; };
+
+#define DECLARE_WORK(name, fn) struct work_struct name = { .func = (fn) }
+#define DECLARE_DELAYED_WORK(name, fn) \
+  struct delayed_work name = { .work = { .func = (fn) } }
+#define INIT_WORK(w, fn) (*(w) = (struct work_struct){ .func = (fn) })
+#define INIT_DELAYED_WORK(w, fn) \
+  (*(w) = (struct delayed_work){ .work = { .func = (fn) } })
+#define to_delayed_work(w) container_of(w, struct delayed_work, work)
+#define work_pending(w) ((w)->pending)
+#define delayed_work_pending(w) work_pending(&(w)->work)
+
+extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_freezable_wq;
+struct workqueue_struct *alloc_ordered_workqueue(const char *fmt, unsigned int flags, ...);
+void destroy_workqueue(struct workqueue_struct *wq);
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+      unsigned long delay);
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+          unsigned long delay);
+bool flush_work(struct work_struct *work);
+bool cancel_work_sync(struct work_struct *work);
+bool cancel_delayed_work(struct delayed_work *dwork);
+#define cancel_delayed_work_sync cancel_delayed_work
+#define schedule_work(w) queue_work(system_wq, w)
+#define schedule_delayed_work(w, d) queue_delayed_work(system_wq, w, d)
+/* Runs queued and expired work until none is left, returns items run */
+unsigned int bench_run_work(void);
+
+/* async stages run inline */
+typedef u64 async_cookie_t;
+typedef void (*async_func_t)(void *data, async_cookie_t cookie);
+struct async_domain { async_cookie_t next; };
+#define ASYNC_DOMAIN(name) struct async_domain name = { 0 }
+#define ASYNC_DOMAIN_EXCLUSIVE(name) ASYNC_DOMAIN(name)
+static inline async_cookie_t async_schedule_domain(async_func_t fn, void *data,
+               struct async_domain *domain)
+{
+  async_cookie_t cookie = ++domain->next;
+
+  fn(data, cookie);
+  return cookie;
+}
+static inline void async_synchronize_full_domain(struct async_domain *domain) { }
+
+/* driver model */
+struct kobject { int unused; };
+struct attribute { const char *name; umode_t mode; };
+struct device {
+  struct kobject kobj;
+  struct device *parent;
+  const char *name;
+};
+#define kobj_to_dev(k) container_of(k, struct device, kobj)
+struct device_attribute {
+  struct attribute attr;
+  ssize_t (*show)(struct device *dev, struct device_attribute *attr, char *buf);
+  ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+       const char *buf, size_t count);
+};
+struct file;
+struct bin_attribute {
+  struct attribute attr;
+  size_t size;
+  ssize_t (*read)(struct file *, struct kobject *, struct bin_attribute *,
+      char *, loff_t, size_t);
+  ssize_t (*write)(struct file *, struct kobject *, struct bin_attribute *,
+       char *, loff_t, size_t);
+};
+struct attribute_group {
+  const char *name;
+  umode_t (*is_visible)(struct kobject *, struct attribute *, int);
+  umode_t (*is_bin_visible)(struct kobject *, struct bin_attribute *, int);
+  struct attribute **attrs;
+  struct bin_attribute **bin_attrs;
+};
+#define __ATTR(_name, _mode, _show, _store) \
+  { .attr = { .name = #_name, .mode = _mode }, .show = _show, .store = _store }
+#define DEVICE_ATTR(_name, _mode, _show, _store) \
+  struct device_attribute dev_attr_##_name = __ATTR(_name, _mode, _show, _store)
+#define DEVICE_ATTR_RO(_name) DEVICE_ATTR(_name, 0444, _name##_show, NULL)
+#define DEVICE_ATTR_RW(_name) DEVICE_ATTR(_name, 0644, _name##_show, _name##_store)
+#define DEVICE_ATTR_WO(_name) DEVICE_ATTR(_name, 0200, NULL, _name##_store)
+#define BIN_ATTR(_name, _mode, _read, _write, _size) \
+  struct bin_attribute bin_attr_##_name = { \
+    .attr = { .name = #_name, .mode = _mode }, \
+    .size = _size, .read = _read, .write = _write }
+#define BIN_ATTR_RW(_name, _size) \
+  BIN_ATTR(_name, 0644, _name##_read, _name##_write, _size)
+#define sysfs_attr_init(attr) ((void)(attr))
+int sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp);
+void sysfs_remove_group(struct kobject *kobj, const struct attribute_group *grp);
+
+struct dev_pm_ops {
+  int (*suspend)(struct device *dev);
+  int (*resume)(struct device *dev);
+  int (*freeze)(struct device *dev);
+  int (*thaw)(struct device *dev);
+  int (*restore)(struct device *dev);
+};
+#define PROBE_PREFER_ASYNCHRONOUS 1
+struct device_driver {
+  const char *name;
+  const struct dev_pm_ops *pm;
+  int probe_type;
+  bool suppress_bind_attrs;
+};
+struct platform_device {
+  const char *name;
+  int id;
+  struct device dev;
+};
+struct platform_driver {
+  struct device_driver driver;
+  int (*probe)(struct platform_device *pdev);
+  int (*remove)(struct platform_device *pdev);
+};
+int platform_driver_register(struct platform_driver *drv);
+void platform_driver_unregister(struct platform_driver *drv);
+struct platform_device *platform_device_register_simple(const char *name, int id,
+              const void *res, unsigned int num);
+void platform_device_unregister(struct platform_device *pdev);
+/* The bound driver, for the harness to call its pm_ops */
+extern struct platform_driver *bench_platform_driver;
+
+/* ACPI and WMI, see fake_bios.c */
+#define AE_OK 0
+#define AE_NOT_FOUND 5
+#define AE_BUFFER_OVERFLOW 11
+#define ACPI_FAILURE(s) ((s) != AE_OK)
+#define ACPI_ALLOCATE_BUFFER ((acpi_size)-1)
+#define ACPI_TYPE_BUFFER 3
+struct acpi_buffer {
+  acpi_size length;
+  void *pointer;
+};
+union acpi_object {
+  u32 type;
+  struct {
+    u32 type;
+    u32 length;
+    u8 *pointer;
+  } buffer;
+};
+typedef void (*wmi_notify_handler)(u32 value, void *context);
+bool wmi_has_guid(const char *guid);
+acpi_status wmi_evaluate_method(const char *guid, u8 instance, u32 method_id,
+        const struct acpi_buffer *in, struct acpi_buffer *out);
+acpi_status wmi_get_event_data(u32 event, struct acpi_buffer *out);
+acpi_status wmi_install_notify_handler(const char *guid,
+               wmi_notify_handler handler, void *data);
+acpi_status wmi_remove_notify_handler(const char *guid);
+int ec_read(u8 addr, u8 *val);
+
+/* input */
+#define EV_SW 0x05
+#define SW_TABLET_MODE 0x01
+#define SW_DOCK 0x05
+#define BUS_HOST 0x19
+#define KE_END 0
+#define KE_KEY 1
+#define KEY_BRIGHTNESSDOWN 224
+#define KEY_BRIGHTNESSUP 225
+#define KEY_PROG1 148
+#define KEY_MEDIA 226
+#define KEY_INFO 358
+#define KEY_ROTATE_DISPLAY 153
+#define KEY_SETUP 141
+#define KEY_HELP 138
+#define KEY_F14 184
+#define KEY_F15 185
+#define KEY_F16 186
+#define KEY_F17 187
+struct key_entry {
+  u8 type;
+  u32 code;
+  union {
+    u16 keycode;
+  };
+};
+struct input_dev {
+  const char *name;
+  const char *phys;
+  struct { u16 bustype; } id;
+  unsigned long evbit[1];
+  unsigned long swbit[1];
+  const struct key_entry *keymap;
+};
+struct input_dev *input_allocate_device(void);
+void input_free_device(struct input_dev *dev);
+int input_register_device(struct input_dev *dev);
+void input_unregister_device(struct input_dev *dev);
+void input_report_switch(struct input_dev *dev, unsigned int code, int value);
+static inline void input_sync(struct input_dev *dev) { }
+int sparse_keymap_setup(struct input_dev *dev, const struct key_entry *keymap,
+      void *setup);
+bool sparse_keymap_report_event(struct input_dev *dev, unsigned int code,
+        unsigned int value, bool autorelease);
+/* Key and switch reports seen so far */
+extern u64 bench_input_events;
+
+/* rfkill */
+enum rfkill_type {
+  RFKILL_TYPE_WLAN = 1,
+  RFKILL_TYPE_BLUETOOTH,
+  RFKILL_TYPE_UWB,
+  RFKILL_TYPE_WIMAX,
+  RFKILL_TYPE_WWAN,
+  RFKILL_TYPE_GPS,
+};
+struct rfkill_ops {
+  int (*set_block)(void *data, bool blocked);
+};
+struct rfkill;
+struct rfkill *rfkill_alloc(const char *name, struct device *parent,
+          enum rfkill_type type, const struct rfkill_ops *ops,
+          void *data);
+static inline int rfkill_register(struct rfkill *rfkill) { return 0; }
+static inline void rfkill_unregister(struct rfkill *rfkill) { }
+void rfkill_destroy(struct rfkill *rfkill);
+static inline void rfkill_init_sw_state(struct rfkill *rfkill, bool blocked) { }
+static inline bool rfkill_set_hw_state(struct rfkill *rfkill, bool blocked) { return blocked; }
+static inline void rfkill_set_states(struct rfkill *rfkill, bool sw, bool hw) { }
+
+/* files, debugfs, misc devices */
+struct inode;
+struct dentry;
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+#define EPOLLIN 0x0001
+#define EPOLLRDNORM 0x0040
+struct vm_area_struct {
+  unsigned long vm_start, vm_end, vm_pgoff, vm_flags;
+};
+#define VM_WRITE 0x02
+#define VM_SHARED 0x08
+#define VM_DONTEXPAND 0x40000
+#define VM_DONTDUMP 0x4000000
+struct file {
+  void *private_data;
+  unsigned int f_flags;
+};
+struct file_operations {
+  void *owner;
+  loff_t (*llseek)(struct file *, loff_t, int);
+  ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+  ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+  __poll_t (*poll)(struct file *, poll_table *);
+  long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+  long (*compat_ioctl)(struct file *, unsigned int, unsigned long);
+  int (*mmap)(struct file *, struct vm_area_struct *);
+  int (*open)(struct inode *, struct file *);
+  int (*release)(struct inode *, struct file *);
+};
+#define O_NONBLOCK 04000
+static inline loff_t noop_llseek(struct file *file, loff_t offset, int whence) { return 0; }
+static inline int nonseekable_open(struct inode *inode, struct file *file) { return 0; }
+static inline void poll_wait(struct file *file, wait_queue_head_t *wq, poll_table *p) { }
+#define compat_ptr_ioctl NULL
+static inline int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+              unsigned long pgoff) { return 0; }
+#define copy_to_user(to, from, n) (memcpy(to, from, n), 0UL)
+#define copy_from_user(to, from, n) (memcpy(to, from, n), 0UL)
+#define get_user(x, ptr) ((x) = *(ptr), 0)
+#define put_user(x, ptr) (*(ptr) = (x), 0)
+
+#define MISC_DYNAMIC_MINOR 255
+struct miscdevice {
+  int minor;
+  const char *name;
+  const struct file_operations *fops;
+  umode_t mode;
+};
+static inline int misc_register(struct miscdevice *misc) { return 0; }
+static inline void misc_deregister(struct miscdevice *misc) { }
+
+struct seq_file { FILE *out; };
+#define seq_printf(m, ...) fprintf((m)->out, __VA_ARGS__)
+#define seq_puts(m, s) fputs(s, (m)->out)
+#define seq_putc(m, c) fputc(c, (m)->out)
+#define DEFINE_SHOW_ATTRIBUTE(__name) \
+  static const struct file_operations __name##_fops = { 0 }; \
+  static int (*const __name##_show_fn)(struct seq_file *, void *) \
+    __maybe_unused = __name##_show
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+           struct dentry *parent, void *data,
+           const struct file_operations *fops);
+static inline void debugfs_remove_recursive(struct dentry *dentry) { }
+
+/* ioctl numbers, as in asm-generic/ioctl.h */
+#define _IOC(dir, type, nr, size) \
+  (((dir) << 30) | ((type) << 8) | (nr) | ((size) << 16))
+#define _IO(type, nr) _IOC(0U, type, nr, 0)
+#define _IOR(type, nr, argtype) _IOC(2U, type, nr, sizeof(argtype))
+#define _IOW(type, nr, argtype) _IOC(1U, type, nr, sizeof(argtype))
+
+/* LEDs */
+enum led_brightness {
+  LED_OFF = 0,
+  LED_ON = 1,
+  LED_HALF = 127,
+  LED_FULL = 255,
+};
+#define LED_CORE_SUSPENDRESUME BIT(16)
+#define LED_BRIGHT_HW_CHANGED BIT(21)
+#define LED_RETAIN_AT_SHUTDOWN BIT(22)
+#define LED_COLOR_ID_RED 1
+#define LED_COLOR_ID_GREEN 2
+#define LED_COLOR_ID_BLUE 3
+#define LED_COLOR_ID_RGB 9
+#define LED_COLOR_ID_MULTI 8
+struct led_classdev {
+  const char *name;
+  unsigned int brightness;
+  unsigned int max_brightness;
+  int flags;
+  int color;
+  const char *default_trigger;
+  void (*brightness_set)(struct led_classdev *, enum led_brightness);
+  int (*brightness_set_blocking)(struct led_classdev *, enum led_brightness);
+  enum led_brightness (*brightness_get)(struct led_classdev *);
+};
+struct mc_subled {
+  unsigned int color_index;
+  unsigned int brightness;
+  unsigned int intensity;
+  unsigned int channel;
+};
+struct led_classdev_mc {
+  struct led_classdev led_cdev;
+  unsigned int num_colors;
+  struct mc_subled *subled_info;
+};
+#define lcdev_to_mccdev(l) container_of(l, struct led_classdev_mc, led_cdev)
+static inline int led_classdev_register(struct device *parent,
+          struct led_classdev *led) { return 0; }
+static inline void led_classdev_unregister(struct led_classdev *led) { }
+static inline void led_classdev_notify_brightness_hw_changed(
+  struct led_classdev *led, unsigned int brightness) { }
+static inline int led_classdev_multicolor_register(struct device *parent,
+               struct led_classdev_mc *mc) { return 0; }
+static inline void led_classdev_multicolor_unregister(struct led_classdev_mc *mc) { }
+int led_mc_calc_color_components(struct led_classdev_mc *mc,
+         enum led_brightness brightness);
+
+/* hwmon */
+enum hwmon_sensor_types { hwmon_chip, hwmon_temp, hwmon_in, hwmon_curr,
+  hwmon_power, hwmon_energy, hwmon_humidity, hwmon_fan, hwmon_pwm };
+enum { hwmon_chip_update_interval = 1 };
+enum { hwmon_temp_input = 1, hwmon_temp_label = 2 };
+enum { hwmon_fan_input = 1, hwmon_fan_label = 2 };
+#define HWMON_C_UPDATE_INTERVAL BIT(hwmon_chip_update_interval)
+#define HWMON_T_INPUT BIT(hwmon_temp_input)
+#define HWMON_T_LABEL BIT(hwmon_temp_label)
+#define HWMON_F_INPUT BIT(hwmon_fan_input)
+#define HWMON_F_LABEL BIT(hwmon_fan_label)
+struct hwmon_channel_info {
+  enum hwmon_sensor_types type;
+  const u32 *config;
+};
+#define HWMON_CHANNEL_INFO(stype, ...) \
+  (&(const struct hwmon_channel_info) { \
+    .type = hwmon_##stype, \
+    .config = (const u32 []) { __VA_ARGS__, 0 } })
+struct hwmon_ops {
+  umode_t (*is_visible)(const void *, enum hwmon_sensor_types, u32, int);
+  int (*read)(struct device *, enum hwmon_sensor_types, u32, int, long *);
+  int (*read_string)(struct device *, enum hwmon_sensor_types, u32, int,
+         const char **);
+  int (*write)(struct device *, enum hwmon_sensor_types, u32, int, long);
+};
+struct hwmon_chip_info {
+  const struct hwmon_ops *ops;
+  const struct hwmon_channel_info * const *info;
+};
+struct device *hwmon_device_register_with_info(struct device *dev,
+                 const char *name, void *drvdata,
+                 const struct hwmon_chip_info *info,
+                 const void *extra_groups);
+void hwmon_device_unregister(struct device *dev);
+
+/* platform_profile, the pre-6.14 registration */
+enum platform_profile_option {
+  PLATFORM_PROFILE_LOW_POWER,
+  PLATFORM_PROFILE_COOL,
+  PLATFORM_PROFILE_QUIET,
+  PLATFORM_PROFILE_BALANCED,
+  PLATFORM_PROFILE_BALANCED_PERFORMANCE,
+  PLATFORM_PROFILE_PERFORMANCE,
+  PLATFORM_PROFILE_LAST,
+};
+struct platform_profile_handler {
+  DECLARE_BITMAP(choices, PLATFORM_PROFILE_LAST);
+  int (*profile_get)(struct platform_profile_handler *,
+         enum platform_profile_option *);
+  int (*profile_set)(struct platform_profile_handler *,
+         enum platform_profile_option);
+};
+static inline int platform_profile_register(struct platform_profile_handler *h) { return 0; }
+static inline int platform_profile_remove(void) { return 0; }
+
+/* DMI: the bench machine is the first board of a generated table */
+enum dmi_field { DMI_NONE, DMI_BOARD_NAME = 9 };
+struct dmi_strmatch {
+  unsigned char slot;
+  char substr[79];
+};
+struct dmi_system_id {
+  int (*callback)(const struct dmi_system_id *);
+  const char *ident;
+  struct dmi_strmatch matches[4];
+  void *driver_data;
+};
+#define DMI_MATCH(a, b) { .slot = a, .substr = b }
+#define DMI_EXACT_MATCH(a, b) DMI_MATCH(a, b)
+static inline int dmi_check_system(const struct dmi_system_id *list)
+{
+  if (!list->ident)
+    return 0;
+  if (list->callback)
+    list->callback(list);
+  return 1;
+}
+
+/* Tracepoints compile to nothing */
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TRACE_DEFINE_ENUM(a)
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+  static inline void trace_##name(proto) { }
+
+#endif /* _BENCH_KERNEL_H */
@@ -1,6 +1,16 @@
 """Convert HP Omen devicelist json to a id struct"""
 import json
 
+# Only DisplayName, ProductNum and BackgroundFeature are known fields of
+# the device list, so every listed board gets the full Omen probe and
+# BackgroundFeature is passed through for the module to report.
+def driver_data(dev):
+  background = int(dev["BackgroundFeature"])
+  if not 0 <= background <= 0xffff:
+    raise ValueError("{}: BackgroundFeature {} out of range".format(
+      dev["DisplayName"], background))
+  return "HPWMI_QUIRK_OMEN | HPWMI_QUIRK_BACKGROUND({})".format(background)
+
 def gen_device_list(devices):
   print("static const struct dmi_system_id omen_quirks[] __initconst = {")
   for dev in devices:
@@ -11,8 +21,8 @@ def gen_device_list(devices):
     .matches = {{
       DMI_EXACT_MATCH(DMI_BOARD_NAME, "{}"),
       }},
-    .driver_data = {},
-  }},""".format(dev["DisplayName"], board, dev["BackgroundFeature"]))
+    .driver_data = (void *)({}),
+  }},""".format(dev["DisplayName"], board, driver_data(dev)))
   print("  {}\n};\n")
 
 if __name__ == "__main__":
@@ -23,4 +33,3 @@ if __name__ == "__main__":
     print("// ident.h")
     print("// generated by gen_ident.py from HP.Omen.DeviceLib.JSON.DeviceList.json\n")
     gen_device_list(devicelist)
-
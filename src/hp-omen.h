@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+ * Userspace interface of the HP Omen WMI driver
+ */
+
+#ifndef _HP_OMEN_H
+#define _HP_OMEN_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * /dev/hp-omen-lighting
+ *
+ * mmap() the device with MAP_SHARED to get the lighting framebuffer:
+ * three bytes (red, green, blue) per zone, fb_size bytes in total; a
+ * MAP_PRIVATE mapping fails with EINVAL. Fill in a frame, then
+ * hand it to the driver with HP_OMEN_LIGHTING_COMMIT and a sequence
+ * number of your choice. Commits never block on the firmware; if a frame
+ * is still waiting to be written when the next one is committed, the
+ * older one is dropped.
+ */
+struct hp_omen_lighting_info {
+  __u32 zone_count;
+  __u32 fb_size;
+};
+
+struct hp_omen_lighting_stats {
+  __u64 committed;	/* frames handed to the driver */
+  __u64 written;	/* frames that reached the firmware */
+  __u64 dropped;	/* frames replaced before they were written */
+  __u32 last_seq;	/* sequence number of the last written frame */
+  __u32 skipped;	/* frames not written while a host effect ran */
+};
+
+#define HP_OMEN_IOC_MAGIC 'H'
+
+#define HP_OMEN_LIGHTING_GET_INFO _IOR(HP_OMEN_IOC_MAGIC, 0x00, struct hp_omen_lighting_info)
+#define HP_OMEN_LIGHTING_COMMIT _IOW(HP_OMEN_IOC_MAGIC, 0x01, __u32)
+#define HP_OMEN_LIGHTING_GET_STATS _IOR(HP_OMEN_IOC_MAGIC, 0x02, struct hp_omen_lighting_stats)
+
+/*
+ * /dev/hp-wmi-events
+ *
+ * Every reader gets its own queue of firmware events. read() returns as
+ * many whole records as fit into the buffer and blocks while the queue is
+ * empty, unless the file was opened with O_NONBLOCK. poll() reports
+ * POLLIN while events are queued. Events that arrive while the queue is
+ * full are dropped and counted, see HP_OMEN_EVENTS_GET_OVERFLOW.
+ */
+struct hp_omen_event {
+  __u64 timestamp_ns;	/* CLOCK_MONOTONIC */
+  __u32 id;		/* event id as sent by the firmware */
+  __u32 data;
+};
+
+#define HP_OMEN_EVENTS_GET_OVERFLOW _IOR(HP_OMEN_IOC_MAGIC, 0x10, __u64)
+
+#endif /* _HP_OMEN_H */
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for the HP WMI driver
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hp_wmi
+
+#ifndef _HP_WMI_TRACE_ENUMS
+#define _HP_WMI_TRACE_ENUMS
+
+/* How hp_wmi_notify got (or failed to get) its event */
+enum hp_wmi_event_path {
+  HPWMI_EVENT_PATH_NO_DATA,
+  HPWMI_EVENT_PATH_BUFFER8,
+  HPWMI_EVENT_PATH_BUFFER16,
+  HPWMI_EVENT_PATH_BAD_STATUS,
+  HPWMI_EVENT_PATH_BAD_TYPE,
+  HPWMI_EVENT_PATH_BAD_LENGTH,
+};
+
+#endif
+
+#if !defined(_HP_WMI_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HP_WMI_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(HPWMI_EVENT_PATH_NO_DATA);
+TRACE_DEFINE_ENUM(HPWMI_EVENT_PATH_BUFFER8);
+TRACE_DEFINE_ENUM(HPWMI_EVENT_PATH_BUFFER16);
+TRACE_DEFINE_ENUM(HPWMI_EVENT_PATH_BAD_STATUS);
+TRACE_DEFINE_ENUM(HPWMI_EVENT_PATH_BAD_TYPE);
+TRACE_DEFINE_ENUM(HPWMI_EVENT_PATH_BAD_LENGTH);
+
+TRACE_EVENT(hp_wmi_query_start,
+
+  TP_PROTO(u32 command, u32 commandtype, int insize, int outsize),
+
+  TP_ARGS(command, commandtype, insize, outsize),
+
+  TP_STRUCT__entry(
+    __field(u32, command)
+    __field(u32, commandtype)
+    __field(int, insize)
+    __field(int, outsize)
+  ),
+
+  TP_fast_assign(
+    __entry->command = command;
+    __entry->commandtype = commandtype;
+    __entry->insize = insize;
+    __entry->outsize = outsize;
+  ),
+
+  TP_printk("command=0x%x commandtype=0x%x insize=%d outsize=%d",
+      __entry->command, __entry->commandtype,
+      __entry->insize, __entry->outsize)
+);
+
+TRACE_EVENT(hp_wmi_query_done,
+
+  TP_PROTO(u32 command, u32 commandtype, int insize, int outsize,
+     int ret, u64 duration_ns),
+
+  TP_ARGS(command, commandtype, insize, outsize, ret, duration_ns),
+
+  TP_STRUCT__entry(
+    __field(u32, command)
+    __field(u32, commandtype)
+    __field(int, insize)
+    __field(int, outsize)
+    __field(int, ret)
+    __field(u64, duration_ns)
+  ),
+
+  TP_fast_assign(
+    __entry->command = command;
+    __entry->commandtype = commandtype;
+    __entry->insize = insize;
+    __entry->outsize = outsize;
+    __entry->ret = ret;
+    __entry->duration_ns = duration_ns;
+  ),
+
+  TP_printk("command=0x%x commandtype=0x%x insize=%d outsize=%d ret=%d duration_ns=%llu",
+      __entry->command, __entry->commandtype,
+      __entry->insize, __entry->outsize,
+      __entry->ret, __entry->duration_ns)
+);
+
+TRACE_EVENT(hp_wmi_event,
+
+  TP_PROTO(u32 event_id, u32 event_data, u32 length, int path),
+
+  TP_ARGS(event_id, event_data, length, path),
+
+  TP_STRUCT__entry(
+    __field(u32, event_id)
+    __field(u32, event_data)
+    __field(u32, length)
+    __field(int, path)
+  ),
+
+  TP_fast_assign(
+    __entry->event_id = event_id;
+    __entry->event_data = event_data;
+    __entry->length = length;
+    __entry->path = path;
+  ),
+
+  TP_printk("event_id=0x%x event_data=0x%x length=%u path=%s",
+      __entry->event_id, __entry->event_data, __entry->length,
+      __print_symbolic(__entry->path,
+           { HPWMI_EVENT_PATH_NO_DATA, "no_data" },
+           { HPWMI_EVENT_PATH_BUFFER8, "buffer8" },
+           { HPWMI_EVENT_PATH_BUFFER16, "buffer16" },
+           { HPWMI_EVENT_PATH_BAD_STATUS, "bad_status" },
+           { HPWMI_EVENT_PATH_BAD_TYPE, "bad_type" },
+           { HPWMI_EVENT_PATH_BAD_LENGTH, "bad_length" }))
+);
+
+TRACE_EVENT(hp_wmi_key,
+
+  TP_PROTO(int key_code, bool known),
+
+  TP_ARGS(key_code, known),
+
+  TP_STRUCT__entry(
+    __field(int, key_code)
+    __field(bool, known)
+  ),
+
+  TP_fast_assign(
+    __entry->key_code = key_code;
+    __entry->known = known;
+  ),
+
+  TP_printk("key_code=0x%x known=%d", __entry->key_code, __entry->known)
+);
+
+#endif /* _HP_WMI_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hp-wmi-trace
+#include <trace/define_trace.h>
@@ -27,6 +27,28 @@
 #include <linux/acpi.h>
 #include <linux/rfkill.h>
 #include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/kfifo.h>
+#include <linux/leds.h>
+#include <linux/led-class-multicolor.h>
+#include <linux/miscdevice.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <linux/hwmon.h>
+#include <linux/platform_profile.h>
+#include <linux/dmi.h>
+#include <linux/async.h>
+#include <linux/poll.h>
+
+#include "hp-omen.h"
+
+#define CREATE_TRACE_POINTS
+#include "hp-wmi-trace.h"
 
 #ifdef STUPID_INTELLISENSE_HACK
 #define pr_err(...)
@@ -99,12 +121,23 @@ enum hp_wmi_commandtype {
   HPWMI_FOURZONE_BRIGHT_SET = 5,
   HPWMI_FOURZONE_ANIM_GET = 6,
   HPWMI_FOURZONE_ANIM_SET = 7,
+
+  HPWMI_SET_PERFORMANCE_MODE = 0x1a,
+  HPWMI_GET_GPU_THERMAL_MODES_QUERY = 0x21,
+  HPWMI_SET_GPU_THERMAL_MODES_QUERY = 0x22,
+  HPWMI_TEMPERATURE_GET_QUERY = 0x23,
+  HPWMI_FAN_SPEED_MAX_GET_QUERY = 0x26,
+  HPWMI_FAN_SPEED_MAX_SET_QUERY = 0x27,
+  HPWMI_GET_SYSTEM_DESIGN_DATA = 0x28,
+  HPWMI_SET_POWER_LIMITS_QUERY = 0x29,
+  HPWMI_FAN_SPEED_GET_QUERY = 0x2d,
 };
 
 enum hp_wmi_command {
   HPWMI_READ	= 0x01,
   HPWMI_WRITE	= 0x02,
   HPWMI_ODM	= 0x03,
+  HPWMI_GM = 0x20008,
   HPWMI_FOURZONE = 131081,
 };
 
@@ -192,6 +225,7 @@ static struct rfkill *wwan_rfkill;
 struct rfkill2_device {
   u8 id;
   int num;
+  u8 power;
   struct rfkill *rfkill;
 };
 
@@ -200,15 +234,75 @@ static struct rfkill2_device rfkill2[HPWMI_MAX_RFKILL2_DEVICES];
 
 /* Determine featureset for specific models */
 
+/* Board capabilities, as encoded by gen_ident.py in the DMI table */
+#define HPWMI_QUIRK_FOURZONE	BIT(0)
+#define HPWMI_QUIRK_FAN		BIT(1)
+#define HPWMI_QUIRK_THERMAL	BIT(2)
+#define HPWMI_QUIRK_ZONES(n)	((n) << 8)
+#define HPWMI_QUIRK_ZONE_COUNT(q)	(((q) >> 8) & 0xff)
+/* The device list's BackgroundFeature value, kept as is */
+#define HPWMI_QUIRK_BACKGROUND(n)	((unsigned long)(n) << 16)
+#define HPWMI_QUIRK_BACKGROUND_FEATURE(q)	(((q) >> 16) & 0xffff)
+
+/*
+ * The device list has no confirmed per-feature fields, so a listed board
+ * gets every Omen probe; the probes themselves drop what it lacks.
+ */
+#define HPWMI_QUIRK_OMEN	(HPWMI_QUIRK_FOURZONE | HPWMI_QUIRK_FAN | \
+         HPWMI_QUIRK_THERMAL | HPWMI_QUIRK_ZONES(4))
+
 struct quirk_entry {
   bool fourzone;
+  u8 zones;
+  bool fan_control;
+  bool thermal_modes;
+  u16 background_feature;
 };
 
-static struct quirk_entry temp_omen = {
+/* Without a board table, every feature is probed */
+static struct quirk_entry quirk_probe_all = {
   .fourzone = true,
+  .zones = 4,
+  .fan_control = true,
+  .thermal_modes = true,
 };
 
-static struct quirk_entry *quirks = &temp_omen;
+static struct quirk_entry *quirks = &quirk_probe_all;
+
+/* ident.h is generated by gen_ident.py, see "make ident" */
+#if __has_include("ident.h")
+static struct quirk_entry quirk_board;
+
+static int __init dmi_matched(const struct dmi_system_id *dmi)
+{
+  unsigned long caps = (unsigned long)dmi->driver_data;
+
+  quirk_board.fourzone = caps & HPWMI_QUIRK_FOURZONE;
+  quirk_board.zones = HPWMI_QUIRK_ZONE_COUNT(caps);
+  quirk_board.fan_control = caps & HPWMI_QUIRK_FAN;
+  quirk_board.thermal_modes = caps & HPWMI_QUIRK_THERMAL;
+  quirk_board.background_feature = HPWMI_QUIRK_BACKGROUND_FEATURE(caps);
+  quirks = &quirk_board;
+
+  pr_info("Identified %s, background feature %u\n", dmi->ident,
+    quirk_board.background_feature);
+  return 1;
+}
+
+#include "ident.h"
+
+/* Boards missing from the table are not Omens, skip the Omen features */
+static void __init hp_wmi_quirks_setup(void)
+{
+  quirks = &quirk_board;
+  if (!dmi_check_system(omen_quirks))
+    pr_info("Board not in the Omen table, Omen features disabled\n");
+}
+#else
+static void __init hp_wmi_quirks_setup(void)
+{
+}
+#endif
 
 /* map output size to the corresponding WMI method id */
 static inline int encode_outsize_for_pvsz(int outsize)
@@ -227,56 +321,239 @@ static inline int encode_outsize_for_pvsz(int outsize)
 }
 
 /*
- * hp_wmi_perform_query
- *
- * query:	The commandtype (enum hp_wmi_commandtype)
- * write:	The command (enum hp_wmi_command)
- * buffer:	Buffer used as input and/or output
- * insize:	Size of input buffer
- * outsize:	Size of output buffer
- *
- * returns zero on success
- *         an HP WMI query specific error code (which is positive)
- *         -EINVAL if the query was not successful at all
- *         -EINVAL if the output buffer size exceeds buffersize
- *
- * Note: The buffersize must at least be the maximum of the input and output
- *       size. E.g. Battery info query is defined to have 1 byte input
- *       and 128 byte output. The caller would do:
- *       buffer = kzalloc(128, GFP_KERNEL);
- *       ret = hp_wmi_perform_query(HPWMI_BATTERY_QUERY, HPWMI_READ, buffer, 1, 128)
+ * Firmware call statistics, per (command, commandtype), in debugfs
  */
-static int hp_wmi_perform_query(int query, enum hp_wmi_command command,
-        void *buffer, int insize, int outsize)
+#define HPWMI_STATS_SLOTS 32
+#define HPWMI_STATS_BUCKETS 20 /* log2 of the latency in microseconds */
+#define HPWMI_STATS_RETURN_CODES 16 /* slot 0 collects everything else */
+
+struct hp_wmi_query_stats {
+  u32 command;
+  u32 commandtype;
+  u64 calls;
+  u64 errors;
+  u64 returns[HPWMI_STATS_RETURN_CODES];
+  u64 total_ns;
+  u64 min_ns;
+  u64 max_ns;
+  u64 hist[HPWMI_STATS_BUCKETS];
+};
+
+static struct hp_wmi_query_stats hp_wmi_stats[HPWMI_STATS_SLOTS];
+static DEFINE_SPINLOCK(hp_wmi_stats_lock);
+static struct dentry *hp_wmi_debugfs;
+
+static void hp_wmi_stats_record(int query, enum hp_wmi_command command,
+        int ret, ktime_t elapsed)
+{
+  struct hp_wmi_query_stats *stats = NULL;
+  u64 ns = ktime_to_ns(elapsed);
+  u64 us = div_u64(ns, NSEC_PER_USEC);
+  int i, bucket;
+
+  bucket = us ? min(ilog2(us) + 1, HPWMI_STATS_BUCKETS - 1) : 0;
+
+  spin_lock(&hp_wmi_stats_lock);
+  for (i = 0; i < HPWMI_STATS_SLOTS; i++) {
+    if (!hp_wmi_stats[i].calls ||
+        (hp_wmi_stats[i].command == command &&
+         hp_wmi_stats[i].commandtype == query)) {
+      stats = &hp_wmi_stats[i];
+      break;
+    }
+  }
+  if (!stats) {
+    spin_unlock(&hp_wmi_stats_lock);
+    pr_warn_once("out of firmware statistics slots\n");
+    return;
+  }
+
+  stats->command = command;
+  stats->commandtype = query;
+  if (!stats->calls++ || ns < stats->min_ns)
+    stats->min_ns = ns;
+  stats->max_ns = max(stats->max_ns, ns);
+  stats->total_ns += ns;
+  stats->hist[bucket]++;
+  if (ret) {
+    stats->errors++;
+    stats->returns[ret > 0 && ret < HPWMI_STATS_RETURN_CODES ? ret : 0]++;
+  }
+  spin_unlock(&hp_wmi_stats_lock);
+}
+
+static int query_stats_show(struct seq_file *m, void *unused)
+{
+  struct hp_wmi_query_stats *stats;
+  int i, j;
+
+  stats = kmalloc(sizeof(hp_wmi_stats), GFP_KERNEL);
+  if (!stats)
+    return -ENOMEM;
+
+  spin_lock(&hp_wmi_stats_lock);
+  memcpy(stats, hp_wmi_stats, sizeof(hp_wmi_stats));
+  spin_unlock(&hp_wmi_stats_lock);
+
+  for (i = 0; i < HPWMI_STATS_SLOTS && stats[i].calls; i++) {
+    seq_printf(m, "command 0x%x commandtype 0x%x: calls %llu errors %llu min %lluus avg %lluus max %lluus\n",
+         stats[i].command, stats[i].commandtype,
+         stats[i].calls, stats[i].errors,
+         div_u64(stats[i].min_ns, NSEC_PER_USEC),
+         div64_u64(stats[i].total_ns, stats[i].calls * NSEC_PER_USEC),
+         div_u64(stats[i].max_ns, NSEC_PER_USEC));
+
+    if (stats[i].errors) {
+      seq_puts(m, "  returns:");
+      for (j = 1; j < HPWMI_STATS_RETURN_CODES; j++)
+        if (stats[i].returns[j])
+          seq_printf(m, " 0x%02x=%llu", j, stats[i].returns[j]);
+      if (stats[i].returns[0])
+        seq_printf(m, " other=%llu", stats[i].returns[0]);
+      seq_putc(m, '\n');
+    }
+
+    seq_puts(m, "  latency:");
+    for (j = 0; j < HPWMI_STATS_BUCKETS; j++)
+      if (stats[i].hist[j])
+        seq_printf(m, " <%luus=%llu", 1UL << j, stats[i].hist[j]);
+    seq_putc(m, '\n');
+  }
+
+  kfree(stats);
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(query_stats);
+
+static ssize_t query_stats_reset_write(struct file *file, const char __user *buf,
+             size_t count, loff_t *ppos)
+{
+  spin_lock(&hp_wmi_stats_lock);
+  memset(hp_wmi_stats, 0, sizeof(hp_wmi_stats));
+  spin_unlock(&hp_wmi_stats_lock);
+  return count;
+}
+
+static const struct file_operations query_stats_reset_fops = {
+  .owner = THIS_MODULE,
+  .write = query_stats_reset_write,
+  .llseek = noop_llseek,
+};
+
+static void hp_wmi_debugfs_init(void)
+{
+  hp_wmi_debugfs = debugfs_create_dir("hp-wmi", NULL);
+
+  debugfs_create_file("query_stats", 0444, hp_wmi_debugfs, NULL,
+          &query_stats_fops);
+  debugfs_create_file("query_stats_reset", 0200, hp_wmi_debugfs, NULL,
+          &query_stats_reset_fops);
+}
+
+static void hp_wmi_debugfs_exit(void)
+{
+  debugfs_remove_recursive(hp_wmi_debugfs);
+}
+
+/*
+ * Firmware calls share one preallocated argument buffer and one output
+ * buffer, both protected by hp_wmi_query_lock. Only the header and the
+ * insize bytes of payload are passed in, and ACPICA copies the result
+ * object into hp_wmi_out instead of allocating it. The output buffer
+ * fits the largest result of method ids 1-4; the 4096 byte method is
+ * never used by this driver and falls back to an allocated buffer.
+ */
+#define HPWMI_OUT_DATA_MAX 1024
+
+static DEFINE_MUTEX(hp_wmi_query_lock);
+static struct bios_args hp_wmi_args = {
+  .signature = 0x55434553,
+};
+static union {
+  union acpi_object obj;
+  u8 raw[sizeof(union acpi_object) + sizeof(struct bios_return) +
+         HPWMI_OUT_DATA_MAX];
+} hp_wmi_out;
+
+/*
+ * Locks the shared argument buffer and returns its payload area, so a
+ * caller can build its request in place and issue it with
+ * hp_wmi_perform_query_locked(). Release with hp_wmi_query_end().
+ */
+static u8 *hp_wmi_query_begin(void)
+{
+  mutex_lock(&hp_wmi_query_lock);
+  return hp_wmi_args.data;
+}
+
+static void hp_wmi_query_end(void)
+{
+  mutex_unlock(&hp_wmi_query_lock);
+}
+
+/*
+ * Classic commandtypes the firmware answered with
+ * HPWMI_RET_UNKNOWN_CMDTYPE when probed at init. Later calls for them
+ * fail right away with the same code instead of trapping into firmware.
+ */
+#define HPWMI_CAPS_MAX 64
+
+static DECLARE_BITMAP(hp_wmi_unsupported, HPWMI_CAPS_MAX);
+static atomic_long_t hp_wmi_caps_skipped = ATOMIC_LONG_INIT(0);
+
+static bool hp_wmi_query_unsupported(int query, enum hp_wmi_command command)
+{
+  if (command != HPWMI_READ && command != HPWMI_WRITE)
+    return false;
+
+  return query >= 0 && query < HPWMI_CAPS_MAX &&
+         test_bit(query, hp_wmi_unsupported);
+}
+
+/* Caller must hold hp_wmi_query_lock, with the payload in hp_wmi_args.data */
+static int hp_wmi_evaluate(int query, enum hp_wmi_command command,
+         int insize, void *buffer, int outsize)
 {
   int mid;
   struct bios_return *bios_return;
   int actual_outsize;
   union acpi_object *obj;
-  struct bios_args args = {
-    .signature = 0x55434553,
-    .command = command,
-    .commandtype = query,
-    .datasize = insize,
-    .data = { 0 },
+  struct acpi_buffer input = {
+    offsetof(struct bios_args, data) + insize, &hp_wmi_args
   };
-  struct acpi_buffer input = { sizeof(struct bios_args), &args };
-  struct acpi_buffer output = { ACPI_ALLOCATE_BUFFER, NULL };
+  struct acpi_buffer output = { sizeof(hp_wmi_out), &hp_wmi_out };
+  acpi_status status;
   int ret = 0;
 
+  lockdep_assert_held(&hp_wmi_query_lock);
+
   mid = encode_outsize_for_pvsz(outsize);
   if (WARN_ON(mid < 0))
     return mid;
 
-  if (WARN_ON(insize > sizeof(args.data)))
+  if (WARN_ON(insize > sizeof(hp_wmi_args.data)))
     return -EINVAL;
-  memcpy(&args.data[0], buffer, insize);
 
-  wmi_evaluate_method(HPWMI_BIOS_GUID, 0, mid, &input, &output);
+  hp_wmi_args.command = command;
+  hp_wmi_args.commandtype = query;
+  hp_wmi_args.datasize = insize;
+
+  if (outsize > HPWMI_OUT_DATA_MAX) {
+    output.length = ACPI_ALLOCATE_BUFFER;
+    output.pointer = NULL;
+  }
+
+  status = wmi_evaluate_method(HPWMI_BIOS_GUID, 0, mid, &input, &output);
+  if (ACPI_FAILURE(status)) {
+    if (status == AE_BUFFER_OVERFLOW)
+      pr_warn_once("query 0x%x result does not fit the output buffer\n", query);
+    return -EINVAL;
+  }
 
   obj = output.pointer;
 
-  if (!obj)
+  /* No result object at all */
+  if (!obj || !output.length)
     return -EINVAL;
 
   if (obj->type != ACPI_TYPE_BUFFER) {
@@ -293,8 +570,8 @@ static int hp_wmi_perform_query(int query, enum hp_wmi_command command,
     goto out_free;
   }
 
-  /* Ignore output data of zero size */
-  if (!outsize)
+  /* Ignore output data of zero size, or if the caller doesn't want it */
+  if (!outsize || !buffer)
     goto out_free;
 
   actual_outsize = min(outsize, (int)(obj->buffer.length - sizeof(*bios_return)));
@@ -302,7 +579,72 @@ static int hp_wmi_perform_query(int query, enum hp_wmi_command command,
   memset(buffer + actual_outsize, 0, outsize - actual_outsize);
 
 out_free:
-  kfree(obj);
+  if (obj != &hp_wmi_out.obj)
+    kfree(obj);
+  return ret;
+}
+
+/*
+ * hp_wmi_perform_query_locked
+ *
+ * Same as hp_wmi_perform_query, for a request that was built in place in
+ * the buffer returned by hp_wmi_query_begin(). buffer only receives the
+ * output and may be NULL to discard it; outsize still selects the method.
+ */
+static int hp_wmi_perform_query_locked(int query, enum hp_wmi_command command,
+        int insize, void *buffer, int outsize)
+{
+  ktime_t start, elapsed;
+  int ret;
+
+  if (hp_wmi_query_unsupported(query, command)) {
+    atomic_long_inc(&hp_wmi_caps_skipped);
+    return HPWMI_RET_UNKNOWN_CMDTYPE;
+  }
+
+  trace_hp_wmi_query_start(command, query, insize, outsize);
+  start = ktime_get();
+  ret = hp_wmi_evaluate(query, command, insize, buffer, outsize);
+  elapsed = ktime_sub(ktime_get(), start);
+  trace_hp_wmi_query_done(command, query, insize, outsize, ret,
+        ktime_to_ns(elapsed));
+  hp_wmi_stats_record(query, command, ret, elapsed);
+  return ret;
+}
+
+/*
+ * hp_wmi_perform_query
+ *
+ * query:	The commandtype (enum hp_wmi_commandtype)
+ * write:	The command (enum hp_wmi_command)
+ * buffer:	Buffer used as input and/or output
+ * insize:	Size of input buffer
+ * outsize:	Size of output buffer
+ *
+ * returns zero on success
+ *         an HP WMI query specific error code (which is positive)
+ *         -EINVAL if the query was not successful at all
+ *         -EINVAL if the output buffer size exceeds buffersize
+ *
+ * Note: The buffersize must at least be the maximum of the input and output
+ *       size. E.g. Battery info query is defined to have 1 byte input
+ *       and 128 byte output. The caller would do:
+ *       buffer = kzalloc(128, GFP_KERNEL);
+ *       ret = hp_wmi_perform_query(HPWMI_BATTERY_QUERY, HPWMI_READ, buffer, 1, 128)
+ */
+static int hp_wmi_perform_query(int query, enum hp_wmi_command command,
+        void *buffer, int insize, int outsize)
+{
+  u8 *data;
+  int ret;
+
+  if (WARN_ON(insize > sizeof(hp_wmi_args.data)))
+    return -EINVAL;
+
+  data = hp_wmi_query_begin();
+  memcpy(data, buffer, insize);
+  ret = hp_wmi_perform_query_locked(query, command, insize, buffer, outsize);
+  hp_wmi_query_end();
   return ret;
 }
 
@@ -319,9 +661,170 @@ static int hp_wmi_read_int(int query)
   return val;
 }
 
+/*
+ * Status queries that userspace polls are served from a small cache, one
+ * entry per commandtype, each with its own lifetime. Lookups only take
+ * the entry's seqlock as readers. Events that announce a change drop the
+ * matching entry, and the generation count keeps a query that raced with
+ * such an event from storing its stale answer.
+ */
+enum hp_wmi_status_slot {
+  HPWMI_STATUS_DISPLAY,
+  HPWMI_STATUS_HDDTEMP,
+  HPWMI_STATUS_ALS,
+  HPWMI_STATUS_HARDWARE,
+  HPWMI_STATUS_POSTCODE,
+  HPWMI_STATUS_COUNT
+};
+
+struct hp_wmi_status_entry {
+  seqlock_t lock;
+  unsigned int generation;
+  unsigned long expires;
+  int value;
+  bool valid;
+};
+
+static const int hp_wmi_status_queries[HPWMI_STATUS_COUNT] = {
+  [HPWMI_STATUS_DISPLAY] = HPWMI_DISPLAY_QUERY,
+  [HPWMI_STATUS_HDDTEMP] = HPWMI_HDDTEMP_QUERY,
+  [HPWMI_STATUS_ALS] = HPWMI_ALS_QUERY,
+  [HPWMI_STATUS_HARDWARE] = HPWMI_HARDWARE_QUERY,
+  [HPWMI_STATUS_POSTCODE] = HPWMI_POSTCODEERROR_QUERY,
+};
+
+static unsigned int hp_wmi_status_ttl_ms[HPWMI_STATUS_COUNT] = {
+  [HPWMI_STATUS_DISPLAY] = 1000,
+  [HPWMI_STATUS_HDDTEMP] = 1000,
+  [HPWMI_STATUS_ALS] = 1000,
+  [HPWMI_STATUS_HARDWARE] = 1000,
+  [HPWMI_STATUS_POSTCODE] = 60000,
+};
+module_param_array_named(status_ttl_ms, hp_wmi_status_ttl_ms, uint, NULL, 0644);
+MODULE_PARM_DESC(status_ttl_ms, "Cache lifetime in ms of the display, hddtemp, als, hardware and postcode queries (0 disables caching)");
+
+static struct hp_wmi_status_entry hp_wmi_status[HPWMI_STATUS_COUNT];
+
+static void hp_wmi_status_init(void)
+{
+  int i;
+
+  for (i = 0; i < HPWMI_STATUS_COUNT; i++)
+    seqlock_init(&hp_wmi_status[i].lock);
+}
+
+static void hp_wmi_status_invalidate(enum hp_wmi_status_slot slot)
+{
+  struct hp_wmi_status_entry *entry = &hp_wmi_status[slot];
+
+  write_seqlock(&entry->lock);
+  entry->valid = false;
+  entry->generation++;
+  write_sequnlock(&entry->lock);
+}
+
+static void hp_wmi_status_invalidate_all(void)
+{
+  int i;
+
+  for (i = 0; i < HPWMI_STATUS_COUNT; i++)
+    hp_wmi_status_invalidate(i);
+}
+
+static int hp_wmi_read_status(enum hp_wmi_status_slot slot)
+{
+  struct hp_wmi_status_entry *entry = &hp_wmi_status[slot];
+  unsigned int seq, generation;
+  int value;
+  bool hit;
+
+  do {
+    seq = read_seqbegin(&entry->lock);
+    hit = entry->valid && time_before(jiffies, entry->expires);
+    value = entry->value;
+    generation = entry->generation;
+  } while (read_seqretry(&entry->lock, seq));
+
+  if (hit)
+    return value;
+
+  value = hp_wmi_read_int(hp_wmi_status_queries[slot]);
+  if (value < 0)
+    return value;
+
+  write_seqlock(&entry->lock);
+  if (entry->generation == generation) {
+    entry->value = value;
+    entry->expires = jiffies +
+      msecs_to_jiffies(READ_ONCE(hp_wmi_status_ttl_ms[slot]));
+    entry->valid = true;
+  }
+  write_sequnlock(&entry->lock);
+
+  return value;
+}
+
+static const struct {
+  int query;
+  const char *name;
+  int size;
+} hp_wmi_caps_queries[] = {
+  { HPWMI_DISPLAY_QUERY, "display", sizeof(int) },
+  { HPWMI_HDDTEMP_QUERY, "hddtemp", sizeof(int) },
+  { HPWMI_ALS_QUERY, "als", sizeof(int) },
+  { HPWMI_HARDWARE_QUERY, "hardware", sizeof(int) },
+  { HPWMI_WIRELESS_QUERY, "wireless", sizeof(int) },
+  { HPWMI_FEATURE_QUERY, "feature", sizeof(int) },
+  { HPWMI_FEATURE2_QUERY, "feature2", 128 },
+  { HPWMI_WIRELESS2_QUERY, "wireless2", sizeof(struct bios_rfkill2_state) },
+  { HPWMI_POSTCODEERROR_QUERY, "postcode", sizeof(int) },
+};
+
+static int hp_wmi_caps_ret[ARRAY_SIZE(hp_wmi_caps_queries)];
+
+/* Reads every commandtype above once, in a single session */
+static int hp_wmi_caps_probe(struct platform_device *device)
+{
+  u8 *data;
+  int i, ret;
+
+  data = hp_wmi_query_begin();
+  for (i = 0; i < ARRAY_SIZE(hp_wmi_caps_queries); i++) {
+    memset(data, 0, hp_wmi_caps_queries[i].size);
+    ret = hp_wmi_perform_query_locked(hp_wmi_caps_queries[i].query,
+              HPWMI_READ,
+              hp_wmi_caps_queries[i].size, NULL,
+              hp_wmi_caps_queries[i].size);
+    hp_wmi_caps_ret[i] = ret;
+    if (ret == HPWMI_RET_UNKNOWN_CMDTYPE)
+      set_bit(hp_wmi_caps_queries[i].query, hp_wmi_unsupported);
+  }
+  hp_wmi_query_end();
+
+  return 0;
+}
+
+static int caps_show(struct seq_file *m, void *unused)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(hp_wmi_caps_queries); i++)
+    seq_printf(m, "commandtype 0x%02x %s: %s (%d)\n",
+         hp_wmi_caps_queries[i].query, hp_wmi_caps_queries[i].name,
+         hp_wmi_query_unsupported(hp_wmi_caps_queries[i].query,
+                HPWMI_READ) ?
+         "unsupported" : "supported",
+         hp_wmi_caps_ret[i]);
+  seq_printf(m, "calls skipped: %ld\n",
+       atomic_long_read(&hp_wmi_caps_skipped));
+  return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(caps);
+
 static int hp_wmi_hw_state(int mask)
 {
-  int state = hp_wmi_read_int(HPWMI_HARDWARE_QUERY);
+  int state = hp_wmi_read_status(HPWMI_STATUS_HARDWARE);
 
   if (state < 0)
     return state;
@@ -329,7 +832,7 @@ static int hp_wmi_hw_state(int mask)
   return !!(state & mask);
 }
 
-static int __init hp_wmi_bios_2008_later(void)
+static int hp_wmi_bios_2008_later(void)
 {
   int state = 0;
   int ret = hp_wmi_perform_query(HPWMI_FEATURE_QUERY, HPWMI_READ, &state,
@@ -340,9 +843,9 @@ static int __init hp_wmi_bios_2008_later(void)
   return (ret == HPWMI_RET_UNKNOWN_CMDTYPE) ? 0 : -ENXIO;
 }
 
-static int __init hp_wmi_bios_2009_later(void)
+static int hp_wmi_bios_2009_later(void)
 {
-  u8 state[128];
+  u8 state[128] = { 0 };
   int ret = hp_wmi_perform_query(HPWMI_FEATURE2_QUERY, HPWMI_READ, &state,
                sizeof(state), sizeof(state));
   if (!ret)
@@ -351,7 +854,7 @@ static int __init hp_wmi_bios_2009_later(void)
   return (ret == HPWMI_RET_UNKNOWN_CMDTYPE) ? 0 : -ENXIO;
 }
 
-static int __init hp_wmi_enable_hotkeys(void)
+static int hp_wmi_enable_hotkeys(void)
 {
   int value = 0x6e;
   int ret = hp_wmi_perform_query(HPWMI_BIOS_QUERY, HPWMI_WRITE, &value,
@@ -360,6 +863,19 @@ static int __init hp_wmi_enable_hotkeys(void)
   return ret <= 0 ? ret : -EINVAL;
 }
 
+/*
+ * Wireless state is refreshed from one snapshot per query: a single
+ * WIRELESS_QUERY (or WIRELESS2_QUERY) is decoded for every radio and
+ * compared with the previous snapshot, and only radios whose state
+ * changed are pushed to rfkill. Successful set_block calls patch the
+ * snapshot, so it always matches what rfkill was last told.
+ */
+static DEFINE_MUTEX(hp_wmi_wireless_lock);
+static int hp_wmi_wireless_state = -1;
+
+#define HPWMI_WIRELESS_SW_MASK(r) (0x200 << ((r) * 8))
+#define HPWMI_WIRELESS_HW_MASK(r) (0x800 << ((r) * 8))
+
 static int hp_wmi_set_block(void *data, bool blocked)
 {
   enum hp_wmi_radio r = (enum hp_wmi_radio) data;
@@ -369,6 +885,17 @@ static int hp_wmi_set_block(void *data, bool blocked)
   ret = hp_wmi_perform_query(HPWMI_WIRELESS_QUERY, HPWMI_WRITE,
            &query, sizeof(query), 0);
 
+  if (!ret) {
+    mutex_lock(&hp_wmi_wireless_lock);
+    if (hp_wmi_wireless_state >= 0) {
+      if (blocked)
+        hp_wmi_wireless_state &= ~HPWMI_WIRELESS_SW_MASK(r);
+      else
+        hp_wmi_wireless_state |= HPWMI_WIRELESS_SW_MASK(r);
+    }
+    mutex_unlock(&hp_wmi_wireless_lock);
+  }
+
   return ret <= 0 ? ret : -EINVAL;
 }
 
@@ -376,38 +903,77 @@ static const struct rfkill_ops hp_wmi_rfkill_ops = {
   .set_block = hp_wmi_set_block,
 };
 
-static bool hp_wmi_get_sw_state(enum hp_wmi_radio r)
+static bool hp_wmi_get_sw_state(int wireless, enum hp_wmi_radio r)
 {
-  int mask = 0x200 << (r * 8);
+  return !(wireless & HPWMI_WIRELESS_SW_MASK(r));
+}
 
-  int wireless = hp_wmi_read_int(HPWMI_WIRELESS_QUERY);
+static bool hp_wmi_get_hw_state(int wireless, enum hp_wmi_radio r)
+{
+  return !(wireless & HPWMI_WIRELESS_HW_MASK(r));
+}
 
-  /* TBD: Pass error */
-  WARN_ONCE(wireless < 0, "error executing HPWMI_WIRELESS_QUERY");
+static void hp_wmi_rfkill_update(struct rfkill *rfkill, enum hp_wmi_radio r,
+         int wireless, int changed)
+{
+  if (!rfkill ||
+      !(changed & (HPWMI_WIRELESS_SW_MASK(r) | HPWMI_WIRELESS_HW_MASK(r))))
+    return;
 
-  return !(wireless & mask);
+  rfkill_set_states(rfkill,
+        hp_wmi_get_sw_state(wireless, r),
+        hp_wmi_get_hw_state(wireless, r));
 }
 
-static bool hp_wmi_get_hw_state(enum hp_wmi_radio r)
+static int hp_wmi_rfkill_refresh(void)
 {
-  int mask = 0x800 << (r * 8);
+  int wireless, changed;
+
+  wireless = hp_wmi_read_int(HPWMI_WIRELESS_QUERY);
+  if (wireless < 0) {
+    pr_warn_ratelimited("error executing HPWMI_WIRELESS_QUERY\n");
+    return wireless;
+  }
 
-  int wireless = hp_wmi_read_int(HPWMI_WIRELESS_QUERY);
+  mutex_lock(&hp_wmi_wireless_lock);
+  changed = hp_wmi_wireless_state < 0 ? ~0 : wireless ^ hp_wmi_wireless_state;
+  hp_wmi_wireless_state = wireless;
 
-  /* TBD: Pass error */
-  WARN_ONCE(wireless < 0, "error executing HPWMI_WIRELESS_QUERY");
+  hp_wmi_rfkill_update(wifi_rfkill, HPWMI_WIFI, wireless, changed);
+  hp_wmi_rfkill_update(bluetooth_rfkill, HPWMI_BLUETOOTH, wireless, changed);
+  hp_wmi_rfkill_update(wwan_rfkill, HPWMI_WWAN, wireless, changed);
+  mutex_unlock(&hp_wmi_wireless_lock);
 
-  return !(wireless & mask);
+  return 0;
 }
 
 static int hp_wmi_rfkill2_set_block(void *data, bool blocked)
 {
   int rfkill_id = (int)(long)data;
-  char buffer[4] = { 0x01, 0x00, rfkill_id, !blocked };
-  int ret;
-
-  ret = hp_wmi_perform_query(HPWMI_WIRELESS2_QUERY, HPWMI_WRITE,
-           buffer, sizeof(buffer), 0);
+  u8 *buffer;
+  int ret, i;
+
+  buffer = hp_wmi_query_begin();
+  buffer[0] = 0x01;
+  buffer[1] = 0x00;
+  buffer[2] = rfkill_id;
+  buffer[3] = !blocked;
+  ret = hp_wmi_perform_query_locked(HPWMI_WIRELESS2_QUERY, HPWMI_WRITE,
+            4, NULL, 0);
+  hp_wmi_query_end();
+
+  if (!ret) {
+    mutex_lock(&hp_wmi_wireless_lock);
+    for (i = 0; i < rfkill2_count; i++) {
+      if (rfkill2[i].num != rfkill_id)
+        continue;
+      if (blocked)
+        rfkill2[i].power &= ~HPWMI_POWER_SOFT;
+      else
+        rfkill2[i].power |= HPWMI_POWER_SOFT;
+    }
+    mutex_unlock(&hp_wmi_wireless_lock);
+  }
 
   return ret <= 0 ? ret : -EINVAL;
 }
@@ -418,7 +984,7 @@ static const struct rfkill_ops hp_wmi_rfkill2_ops = {
 
 static int hp_wmi_rfkill2_refresh(void)
 {
-  struct bios_rfkill2_state state;
+  struct bios_rfkill2_state state = { 0 };
   int err, i;
 
   err = hp_wmi_perform_query(HPWMI_WIRELESS2_QUERY, HPWMI_READ, &state,
@@ -426,6 +992,7 @@ static int hp_wmi_rfkill2_refresh(void)
   if (err)
     return err;
 
+  mutex_lock(&hp_wmi_wireless_lock);
   for (i = 0; i < rfkill2_count; i++) {
     int num = rfkill2[i].num;
     struct bios_rfkill2_device_state *devstate;
@@ -437,10 +1004,15 @@ static int hp_wmi_rfkill2_refresh(void)
       continue;
     }
 
+    if (devstate->power == rfkill2[i].power)
+      continue;
+    rfkill2[i].power = devstate->power;
+
     rfkill_set_states(rfkill2[i].rfkill,
           IS_SWBLOCKED(devstate->power),
           IS_HWBLOCKED(devstate->power));
   }
+  mutex_unlock(&hp_wmi_wireless_lock);
 
   return 0;
 }
@@ -448,7 +1020,7 @@ static int hp_wmi_rfkill2_refresh(void)
 static ssize_t display_show(struct device *dev, struct device_attribute *attr,
           char *buf)
 {
-  int value = hp_wmi_read_int(HPWMI_DISPLAY_QUERY);
+  int value = hp_wmi_read_status(HPWMI_STATUS_DISPLAY);
   if (value < 0)
     return value;
   return sprintf(buf, "%d\n", value);
@@ -457,7 +1029,7 @@ static ssize_t display_show(struct device *dev, struct device_attribute *attr,
 static ssize_t hddtemp_show(struct device *dev, struct device_attribute *attr,
           char *buf)
 {
-  int value = hp_wmi_read_int(HPWMI_HDDTEMP_QUERY);
+  int value = hp_wmi_read_status(HPWMI_STATUS_HDDTEMP);
   if (value < 0)
     return value;
   return sprintf(buf, "%d\n", value);
@@ -466,7 +1038,7 @@ static ssize_t hddtemp_show(struct device *dev, struct device_attribute *attr,
 static ssize_t als_show(struct device *dev, struct device_attribute *attr,
       char *buf)
 {
-  int value = hp_wmi_read_int(HPWMI_ALS_QUERY);
+  int value = hp_wmi_read_status(HPWMI_STATUS_ALS);
   if (value < 0)
     return value;
   return sprintf(buf, "%d\n", value);
@@ -494,7 +1066,7 @@ static ssize_t postcode_show(struct device *dev, struct device_attribute *attr,
            char *buf)
 {
   /* Get the POST error code of previous boot failure. */
-  int value = hp_wmi_read_int(HPWMI_POSTCODEERROR_QUERY);
+  int value = hp_wmi_read_status(HPWMI_STATUS_POSTCODE);
   if (value < 0)
     return value;
   return sprintf(buf, "0x%x\n", value);
@@ -506,6 +1078,7 @@ static ssize_t als_store(struct device *dev, struct device_attribute *attr,
   u32 tmp = simple_strtoul(buf, NULL, 10);
   int ret = hp_wmi_perform_query(HPWMI_ALS_QUERY, HPWMI_WRITE, &tmp,
                sizeof(tmp), sizeof(tmp));
+  hp_wmi_status_invalidate(HPWMI_STATUS_ALS);
   if (ret)
     return ret < 0 ? ret : -EINVAL;
 
@@ -529,6 +1102,7 @@ static ssize_t postcode_store(struct device *dev, struct device_attribute *attr,
   tmp = (u32) tmp2;
   ret = hp_wmi_perform_query(HPWMI_POSTCODEERROR_QUERY, HPWMI_WRITE, &tmp,
                sizeof(tmp), sizeof(tmp));
+  hp_wmi_status_invalidate(HPWMI_STATUS_POSTCODE);
 
 out:
   if (ret)
@@ -544,67 +1118,81 @@ static DEVICE_ATTR_RO(dock);
 static DEVICE_ATTR_RO(tablet);
 static DEVICE_ATTR_RW(postcode);
 
-static void hp_wmi_notify(u32 value, void *context)
-{
-  struct acpi_buffer response = { ACPI_ALLOCATE_BUFFER, NULL };
-  u32 event_id, event_data;
-  union acpi_object *obj;
-  acpi_status status;
-  u32 *location;
-  int key_code;
+static struct attribute *hp_wmi_attrs[] = {
+  &dev_attr_display.attr,
+  &dev_attr_hddtemp.attr,
+  &dev_attr_als.attr,
+  &dev_attr_dock.attr,
+  &dev_attr_tablet.attr,
+  &dev_attr_postcode.attr,
+  NULL
+};
 
-  status = wmi_get_event_data(value, &response);
-  if (status == AE_NOT_FOUND)
-  {
-    // We've been woken up without any event data
-    // Some models do this when the Omen hotkey is pressed
-    event_id = HPWMI_OMEN_KEY;
-  }
-  else if (status != AE_OK) {
-    pr_info("bad event value 0x%x status 0x%x\n", value, status);
-    return;
-  }
+static umode_t hp_wmi_attr_visible(struct kobject *kobj,
+           struct attribute *attr, int n)
+{
+  int query;
+
+  if (attr == &dev_attr_display.attr)
+    query = HPWMI_DISPLAY_QUERY;
+  else if (attr == &dev_attr_hddtemp.attr)
+    query = HPWMI_HDDTEMP_QUERY;
+  else if (attr == &dev_attr_als.attr)
+    query = HPWMI_ALS_QUERY;
+  else if (attr == &dev_attr_dock.attr || attr == &dev_attr_tablet.attr)
+    query = HPWMI_HARDWARE_QUERY;
+  else if (attr == &dev_attr_postcode.attr)
+    query = HPWMI_POSTCODEERROR_QUERY;
   else
-  {
-    obj = (union acpi_object *)response.pointer;
+    return attr->mode;
 
-    if (!obj)
-      return;
-    if (obj->type != ACPI_TYPE_BUFFER) {
-      pr_info("Unknown response received %d\n", obj->type);
-      kfree(obj);
-      return;
-    }
+  return hp_wmi_query_unsupported(query, HPWMI_READ) ? 0 : attr->mode;
+}
 
-    /*
-    * Depending on ACPI version the concatenation of id and event data
-    * inside _WED function will result in a 8 or 16 byte buffer.
-    */
-    location = (u32 *)obj->buffer.pointer;
-    if (obj->buffer.length == 8) {
-      event_id = *location;
-      event_data = *(location + 1);
-    } else if (obj->buffer.length == 16) {
-      event_id = *location;
-      event_data = *(location + 2);
-    } else {
-      pr_info("Unknown buffer length %d\n", obj->buffer.length);
-      kfree(obj);
-      return;
-    }
-    kfree(obj);
-  }
+static const struct attribute_group hp_wmi_group = {
+  .attrs = hp_wmi_attrs,
+  .is_visible = hp_wmi_attr_visible,
+};
+
+/* Reports dock and tablet mode from a single HARDWARE_QUERY */
+static void hp_wmi_report_hw_state(void)
+{
+  int state;
+
+  if (!test_bit(SW_DOCK, hp_wmi_input_dev->swbit) &&
+      !test_bit(SW_TABLET_MODE, hp_wmi_input_dev->swbit))
+    return;
+
+  state = hp_wmi_read_status(HPWMI_STATUS_HARDWARE);
+  if (state < 0)
+    return;
+
+  if (test_bit(SW_DOCK, hp_wmi_input_dev->swbit))
+    input_report_switch(hp_wmi_input_dev, SW_DOCK,
+            !!(state & HPWMI_DOCK_MASK));
+  if (test_bit(SW_TABLET_MODE, hp_wmi_input_dev->swbit))
+    input_report_switch(hp_wmi_input_dev, SW_TABLET_MODE,
+            !!(state & HPWMI_TABLET_MASK));
+  input_sync(hp_wmi_input_dev);
+}
+
+static void hp_wmi_wireless_refresh(void)
+{
+  if (rfkill2_count)
+    hp_wmi_rfkill2_refresh();
+  else if (wifi_rfkill || bluetooth_rfkill || wwan_rfkill)
+    hp_wmi_rfkill_refresh();
+}
+
+static void kbd_backlight_hw_changed(void);
+
+/* Dock and wireless events are batched by hp_wmi_event_work_fn */
+static void hp_wmi_handle_event(u32 event_id, u32 event_data)
+{
+  int key_code;
+  bool known;
 
   switch (event_id) {
-  case HPWMI_DOCK_EVENT:
-    if (test_bit(SW_DOCK, hp_wmi_input_dev->swbit))
-      input_report_switch(hp_wmi_input_dev, SW_DOCK,
-              hp_wmi_hw_state(HPWMI_DOCK_MASK));
-    if (test_bit(SW_TABLET_MODE, hp_wmi_input_dev->swbit))
-      input_report_switch(hp_wmi_input_dev, SW_TABLET_MODE,
-              hp_wmi_hw_state(HPWMI_TABLET_MASK));
-    input_sync(hp_wmi_input_dev);
-    break;
   case HPWMI_PARK_HDD:
     break;
   case HPWMI_SMART_ADAPTER:
@@ -617,28 +1205,11 @@ static void hp_wmi_notify(u32 value, void *context)
     if (key_code < 0 || (key_code & HPWMI_HOTKEY_RELEASE_FLAG))
       break;
 
-    if (!sparse_keymap_report_event(hp_wmi_input_dev,
-            key_code, 1, true))
-      pr_info("Unknown key code - 0x%x\n", key_code);
-    break;
-  case HPWMI_WIRELESS:
-    if (rfkill2_count) {
-      hp_wmi_rfkill2_refresh();
-      break;
-    }
-
-    if (wifi_rfkill)
-      rfkill_set_states(wifi_rfkill,
-            hp_wmi_get_sw_state(HPWMI_WIFI),
-            hp_wmi_get_hw_state(HPWMI_WIFI));
-    if (bluetooth_rfkill)
-      rfkill_set_states(bluetooth_rfkill,
-            hp_wmi_get_sw_state(HPWMI_BLUETOOTH),
-            hp_wmi_get_hw_state(HPWMI_BLUETOOTH));
-    if (wwan_rfkill)
-      rfkill_set_states(wwan_rfkill,
-            hp_wmi_get_sw_state(HPWMI_WWAN),
-            hp_wmi_get_hw_state(HPWMI_WWAN));
+    known = sparse_keymap_report_event(hp_wmi_input_dev,
+            key_code, 1, true);
+    trace_hp_wmi_key(key_code, known);
+    if (!known)
+      pr_info_ratelimited("Unknown key code - 0x%x\n", key_code);
     break;
   case HPWMI_CPU_BATTERY_THROTTLE:
     pr_info("Unimplemented CPU throttle because of 3 Cell battery event detected\n");
@@ -656,18 +1227,304 @@ static void hp_wmi_notify(u32 value, void *context)
   case HPWMI_PROXIMITY_SENSOR:
     break;
   case HPWMI_BACKLIT_KB_BRIGHTNESS:
+    kbd_backlight_hw_changed();
     break;
   case HPWMI_PEAKSHIFT_PERIOD:
     break;
   case HPWMI_BATTERY_CHARGE_PERIOD:
     break;
   default:
-    pr_info("Unknown event_id - %d - 0x%x\n", event_id, event_data);
+    pr_info_ratelimited("Unknown event_id - %d - 0x%x\n", event_id, event_data);
     break;
   }
 }
 
-static int __init hp_wmi_input_setup(void)
+/*
+ * Events are only decoded in the WMI notify handler and handed to a
+ * dedicated workqueue through a ring. ACPI may run notify handlers
+ * concurrently, so producers serialize on hp_wmi_event_ring_lock; the
+ * ordered workqueue makes the work item the only consumer, which needs
+ * no lock. The work drains the ring in batches, so a burst of dock or
+ * wireless events costs one state refresh rather than one per event.
+ */
+struct hp_wmi_event {
+  u32 id;
+  u32 data;
+};
+
+#define HPWMI_EVENT_RING_SIZE 64
+
+static DEFINE_KFIFO(hp_wmi_event_ring, struct hp_wmi_event, HPWMI_EVENT_RING_SIZE);
+static DEFINE_SPINLOCK(hp_wmi_event_ring_lock);
+static struct workqueue_struct *hp_wmi_wq;
+
+static void hp_wmi_event_work_fn(struct work_struct *work)
+{
+  struct hp_wmi_event event;
+  bool hw_changed = false;
+  bool wireless_changed = false;
+
+  while (kfifo_get(&hp_wmi_event_ring, &event)) {
+    switch (event.id) {
+    case HPWMI_DOCK_EVENT:
+      hw_changed = true;
+      break;
+    case HPWMI_WIRELESS:
+      wireless_changed = true;
+      break;
+    default:
+      hp_wmi_handle_event(event.id, event.data);
+      break;
+    }
+  }
+
+  if (hw_changed) {
+    hp_wmi_status_invalidate(HPWMI_STATUS_HARDWARE);
+    hp_wmi_report_hw_state();
+  }
+  if (wireless_changed)
+    hp_wmi_wireless_refresh();
+}
+
+static DECLARE_WORK(hp_wmi_event_work, hp_wmi_event_work_fn);
+
+/*
+ * /dev/hp-wmi-events hands every firmware event, including the ones the
+ * driver itself ignores, to userspace. Each open file has its own ring
+ * (see hp-omen.h for the record layout); the notify handler is the only
+ * producer and fans events out to all readers under
+ * hp_wmi_readers_lock. A reader that falls behind only loses its own
+ * events.
+ */
+#define HPWMI_EVENT_READER_SIZE 256
+
+struct hp_wmi_event_reader {
+  struct list_head node;
+  DECLARE_KFIFO(ring, struct hp_omen_event, HPWMI_EVENT_READER_SIZE);
+  struct mutex read_lock;
+  u64 overflow;
+};
+
+static LIST_HEAD(hp_wmi_readers);
+static DEFINE_SPINLOCK(hp_wmi_readers_lock);
+static DECLARE_WAIT_QUEUE_HEAD(hp_wmi_events_wait);
+static bool hp_wmi_events_registered;
+
+static void hp_wmi_events_publish(u32 event_id, u32 event_data)
+{
+  struct hp_omen_event event = {
+    .timestamp_ns = ktime_get_ns(),
+    .id = event_id,
+    .data = event_data,
+  };
+  struct hp_wmi_event_reader *reader;
+  unsigned long flags;
+
+  spin_lock_irqsave(&hp_wmi_readers_lock, flags);
+  list_for_each_entry(reader, &hp_wmi_readers, node)
+    if (!kfifo_put(&reader->ring, event))
+      reader->overflow++;
+  spin_unlock_irqrestore(&hp_wmi_readers_lock, flags);
+
+  wake_up_interruptible(&hp_wmi_events_wait);
+}
+
+static int hp_wmi_events_open(struct inode *inode, struct file *file)
+{
+  struct hp_wmi_event_reader *reader;
+  unsigned long flags;
+
+  reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+  if (!reader)
+    return -ENOMEM;
+
+  INIT_KFIFO(reader->ring);
+  mutex_init(&reader->read_lock);
+  file->private_data = reader;
+
+  spin_lock_irqsave(&hp_wmi_readers_lock, flags);
+  list_add_tail(&reader->node, &hp_wmi_readers);
+  spin_unlock_irqrestore(&hp_wmi_readers_lock, flags);
+
+  return nonseekable_open(inode, file);
+}
+
+static int hp_wmi_events_release(struct inode *inode, struct file *file)
+{
+  struct hp_wmi_event_reader *reader = file->private_data;
+  unsigned long flags;
+
+  spin_lock_irqsave(&hp_wmi_readers_lock, flags);
+  list_del(&reader->node);
+  spin_unlock_irqrestore(&hp_wmi_readers_lock, flags);
+
+  kfree(reader);
+  return 0;
+}
+
+static ssize_t hp_wmi_events_read(struct file *file, char __user *buf,
+          size_t count, loff_t *ppos)
+{
+  struct hp_wmi_event_reader *reader = file->private_data;
+  unsigned int copied;
+  int ret;
+
+  count = rounddown(count, sizeof(struct hp_omen_event));
+  if (!count)
+    return -EINVAL;
+
+  do {
+    if (kfifo_is_empty(&reader->ring)) {
+      if (file->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+      ret = wait_event_interruptible(hp_wmi_events_wait,
+                   !kfifo_is_empty(&reader->ring));
+      if (ret)
+        return ret;
+    }
+
+    /* Only one consumer at a time, in case the file is shared */
+    if (mutex_lock_interruptible(&reader->read_lock))
+      return -ERESTARTSYS;
+    ret = kfifo_to_user(&reader->ring, buf, count, &copied);
+    mutex_unlock(&reader->read_lock);
+    if (ret)
+      return ret;
+  } while (!copied);
+
+  return copied;
+}
+
+static __poll_t hp_wmi_events_poll(struct file *file, poll_table *wait)
+{
+  struct hp_wmi_event_reader *reader = file->private_data;
+
+  poll_wait(file, &hp_wmi_events_wait, wait);
+  return kfifo_is_empty(&reader->ring) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+static long hp_wmi_events_ioctl(struct file *file, unsigned int cmd,
+        unsigned long arg)
+{
+  struct hp_wmi_event_reader *reader = file->private_data;
+  unsigned long flags;
+  u64 overflow;
+
+  if (cmd != HP_OMEN_EVENTS_GET_OVERFLOW)
+    return -ENOTTY;
+
+  spin_lock_irqsave(&hp_wmi_readers_lock, flags);
+  overflow = reader->overflow;
+  spin_unlock_irqrestore(&hp_wmi_readers_lock, flags);
+
+  return copy_to_user((void __user *)arg, &overflow, sizeof(overflow)) ?
+    -EFAULT : 0;
+}
+
+static const struct file_operations hp_wmi_events_fops = {
+  .owner = THIS_MODULE,
+  .open = hp_wmi_events_open,
+  .release = hp_wmi_events_release,
+  .read = hp_wmi_events_read,
+  .poll = hp_wmi_events_poll,
+  .unlocked_ioctl = hp_wmi_events_ioctl,
+  .compat_ioctl = compat_ptr_ioctl,
+};
+
+static struct miscdevice hp_wmi_events_miscdev = {
+  .minor = MISC_DYNAMIC_MINOR,
+  .name = "hp-wmi-events",
+  .fops = &hp_wmi_events_fops,
+};
+
+static void hp_wmi_events_setup(void)
+{
+  if (misc_register(&hp_wmi_events_miscdev))
+    pr_warn("failed to register the event device\n");
+  else
+    hp_wmi_events_registered = true;
+}
+
+static void hp_wmi_events_remove(void)
+{
+  if (hp_wmi_events_registered) {
+    misc_deregister(&hp_wmi_events_miscdev);
+    hp_wmi_events_registered = false;
+  }
+}
+
+static void hp_wmi_notify(u32 value, void *context)
+{
+  struct acpi_buffer response = { ACPI_ALLOCATE_BUFFER, NULL };
+  u32 event_id, event_data;
+  union acpi_object *obj;
+  acpi_status status;
+  struct hp_wmi_event event;
+  u32 *location;
+
+  status = wmi_get_event_data(value, &response);
+  if (status == AE_NOT_FOUND)
+  {
+    // We've been woken up without any event data
+    // Some models do this when the Omen hotkey is pressed
+    event_id = HPWMI_OMEN_KEY;
+    event_data = 0;
+    trace_hp_wmi_event(event_id, event_data, 0, HPWMI_EVENT_PATH_NO_DATA);
+  }
+  else if (status != AE_OK) {
+    trace_hp_wmi_event(0, value, 0, HPWMI_EVENT_PATH_BAD_STATUS);
+    pr_info_ratelimited("bad event value 0x%x status 0x%x\n", value, status);
+    return;
+  }
+  else
+  {
+    obj = (union acpi_object *)response.pointer;
+
+    if (!obj)
+      return;
+    if (obj->type != ACPI_TYPE_BUFFER) {
+      trace_hp_wmi_event(0, value, 0, HPWMI_EVENT_PATH_BAD_TYPE);
+      pr_info_ratelimited("Unknown response received %d\n", obj->type);
+      kfree(obj);
+      return;
+    }
+
+    /*
+    * Depending on ACPI version the concatenation of id and event data
+    * inside _WED function will result in a 8 or 16 byte buffer.
+    */
+    location = (u32 *)obj->buffer.pointer;
+    if (obj->buffer.length == 8) {
+      event_id = *location;
+      event_data = *(location + 1);
+      trace_hp_wmi_event(event_id, event_data, obj->buffer.length,
+             HPWMI_EVENT_PATH_BUFFER8);
+    } else if (obj->buffer.length == 16) {
+      event_id = *location;
+      event_data = *(location + 2);
+      trace_hp_wmi_event(event_id, event_data, obj->buffer.length,
+             HPWMI_EVENT_PATH_BUFFER16);
+    } else {
+      trace_hp_wmi_event(0, value, obj->buffer.length,
+             HPWMI_EVENT_PATH_BAD_LENGTH);
+      pr_info_ratelimited("Unknown buffer length %d\n", obj->buffer.length);
+      kfree(obj);
+      return;
+    }
+    kfree(obj);
+  }
+
+  hp_wmi_events_publish(event_id, event_data);
+
+  event.id = event_id;
+  event.data = event_data;
+  if (!kfifo_in_spinlocked(&hp_wmi_event_ring, &event, 1,
+         &hp_wmi_event_ring_lock))
+    pr_warn_ratelimited("event ring full, dropping event 0x%x\n", event_id);
+  queue_work(hp_wmi_wq, &hp_wmi_event_work);
+}
+
+static int hp_wmi_input_setup(void)
 {
   acpi_status status;
   int err, val;
@@ -682,23 +1539,26 @@ static int __init hp_wmi_input_setup(void)
 
   __set_bit(EV_SW, hp_wmi_input_dev->evbit);
 
-  /* Dock */
-  val = hp_wmi_hw_state(HPWMI_DOCK_MASK);
-  if (!(val < 0)) {
-    __set_bit(SW_DOCK, hp_wmi_input_dev->swbit);
-    input_report_switch(hp_wmi_input_dev, SW_DOCK, val);
+  hp_wmi_wq = alloc_ordered_workqueue("hp-wmi", 0);
+  if (!hp_wmi_wq) {
+    err = -ENOMEM;
+    goto err_free_dev;
   }
 
-  /* Tablet mode */
-  val = hp_wmi_hw_state(HPWMI_TABLET_MASK);
+  /* Dock and tablet mode come from the same query */
+  val = hp_wmi_read_int(HPWMI_HARDWARE_QUERY);
   if (!(val < 0)) {
+    __set_bit(SW_DOCK, hp_wmi_input_dev->swbit);
+    input_report_switch(hp_wmi_input_dev, SW_DOCK,
+            !!(val & HPWMI_DOCK_MASK));
     __set_bit(SW_TABLET_MODE, hp_wmi_input_dev->swbit);
-    input_report_switch(hp_wmi_input_dev, SW_TABLET_MODE, val);
+    input_report_switch(hp_wmi_input_dev, SW_TABLET_MODE,
+            !!(val & HPWMI_TABLET_MASK));
   }
 
   err = sparse_keymap_setup(hp_wmi_input_dev, hp_wmi_keymap, NULL);
   if (err)
-    goto err_free_dev;
+    goto err_destroy_wq;
 
   /* Set initial hardware state */
   input_sync(hp_wmi_input_dev);
@@ -709,7 +1569,7 @@ static int __init hp_wmi_input_setup(void)
   status = wmi_install_notify_handler(HPWMI_EVENT_GUID, hp_wmi_notify, NULL);
   if (ACPI_FAILURE(status)) {
     err = -EIO;
-    goto err_free_dev;
+    goto err_destroy_wq;
   }
 
   err = input_register_device(hp_wmi_input_dev);
@@ -720,6 +1580,8 @@ static int __init hp_wmi_input_setup(void)
 
  err_uninstall_notifier:
   wmi_remove_notify_handler(HPWMI_EVENT_GUID);
+ err_destroy_wq:
+  destroy_workqueue(hp_wmi_wq);
  err_free_dev:
   input_free_device(hp_wmi_input_dev);
   return err;
@@ -728,20 +1590,17 @@ static int __init hp_wmi_input_setup(void)
 static void hp_wmi_input_destroy(void)
 {
   wmi_remove_notify_handler(HPWMI_EVENT_GUID);
+  hp_wmi_events_remove();
+  destroy_workqueue(hp_wmi_wq);
   input_unregister_device(hp_wmi_input_dev);
 }
 
 static void cleanup_sysfs(struct platform_device *device)
 {
-  device_remove_file(&device->dev, &dev_attr_display);
-  device_remove_file(&device->dev, &dev_attr_hddtemp);
-  device_remove_file(&device->dev, &dev_attr_als);
-  device_remove_file(&device->dev, &dev_attr_dock);
-  device_remove_file(&device->dev, &dev_attr_tablet);
-  device_remove_file(&device->dev, &dev_attr_postcode);
+  sysfs_remove_group(&device->dev.kobj, &hp_wmi_group);
 }
 
-static int __init hp_wmi_rfkill_setup(struct platform_device *device)
+static int hp_wmi_rfkill_setup(struct platform_device *device)
 {
   int err, wireless;
 
@@ -754,6 +1613,9 @@ static int __init hp_wmi_rfkill_setup(struct platform_device *device)
   if (err)
     return err;
 
+  /* Initial snapshot, every radio below is set up from it */
+  hp_wmi_wireless_state = wireless;
+
   if (wireless & 0x1) {
     wifi_rfkill = rfkill_alloc("hp-wifi", &device->dev,
              RFKILL_TYPE_WLAN,
@@ -762,9 +1624,9 @@ static int __init hp_wmi_rfkill_setup(struct platform_device *device)
     if (!wifi_rfkill)
       return -ENOMEM;
     rfkill_init_sw_state(wifi_rfkill,
-             hp_wmi_get_sw_state(HPWMI_WIFI));
+             hp_wmi_get_sw_state(wireless, HPWMI_WIFI));
     rfkill_set_hw_state(wifi_rfkill,
-            hp_wmi_get_hw_state(HPWMI_WIFI));
+            hp_wmi_get_hw_state(wireless, HPWMI_WIFI));
     err = rfkill_register(wifi_rfkill);
     if (err)
       goto register_wifi_error;
@@ -780,9 +1642,9 @@ static int __init hp_wmi_rfkill_setup(struct platform_device *device)
       goto register_bluetooth_error;
     }
     rfkill_init_sw_state(bluetooth_rfkill,
-             hp_wmi_get_sw_state(HPWMI_BLUETOOTH));
+             hp_wmi_get_sw_state(wireless, HPWMI_BLUETOOTH));
     rfkill_set_hw_state(bluetooth_rfkill,
-            hp_wmi_get_hw_state(HPWMI_BLUETOOTH));
+            hp_wmi_get_hw_state(wireless, HPWMI_BLUETOOTH));
     err = rfkill_register(bluetooth_rfkill);
     if (err)
       goto register_bluetooth_error;
@@ -798,9 +1660,9 @@ static int __init hp_wmi_rfkill_setup(struct platform_device *device)
       goto register_wwan_error;
     }
     rfkill_init_sw_state(wwan_rfkill,
-             hp_wmi_get_sw_state(HPWMI_WWAN));
+             hp_wmi_get_sw_state(wireless, HPWMI_WWAN));
     rfkill_set_hw_state(wwan_rfkill,
-            hp_wmi_get_hw_state(HPWMI_WWAN));
+            hp_wmi_get_hw_state(wireless, HPWMI_WWAN));
     err = rfkill_register(wwan_rfkill);
     if (err)
       goto register_wwan_error;
@@ -824,9 +1686,9 @@ register_wifi_error:
   return err;
 }
 
-static int __init hp_wmi_rfkill2_setup(struct platform_device *device)
+static int hp_wmi_rfkill2_setup(struct platform_device *device)
 {
-  struct bios_rfkill2_state state;
+  struct bios_rfkill2_state state = { 0 };
   int err, i;
 
   err = hp_wmi_perform_query(HPWMI_WIRELESS2_QUERY, HPWMI_READ, &state,
@@ -881,6 +1743,7 @@ static int __init hp_wmi_rfkill2_setup(struct platform_device *device)
 
     rfkill2[rfkill2_count].id = state.device[i].rfkill_id;
     rfkill2[rfkill2_count].num = i;
+    rfkill2[rfkill2_count].power = state.device[i].power;
     rfkill2[rfkill2_count].rfkill = rfkill;
 
     rfkill_init_sw_state(rfkill, IS_SWBLOCKED(state.device[i].power));
@@ -907,188 +1770,2159 @@ fail:
   return err;
 }
 
-/* Support for the HP Omen FourZone keyboard lighting */
-
-#define FOURZONE_COUNT 4
+/*
+ * Omen fan and temperature sensors
+ *
+ * Monitoring tools read every channel every few seconds, so all channels
+ * are sampled together, in one session on the WMI buffer, and served
+ * from a cache for update_interval milliseconds. The firmware only
+ * reports the CPU temperature; the GPU's is read from the EC, which
+ * holds it in whole degrees Celsius on Omen boards. No EC register for a
+ * board or ambient sensor is known.
+ */
+#define HPWMI_FAN_COUNT 2
+#define HPWMI_TEMP_COUNT 2
+#define HPWMI_SENSOR_DATA_SIZE 128
+#define HPWMI_OMEN_EC_GPU_TEMP 0xB7
+
+static DEFINE_MUTEX(hp_wmi_sensors_lock);
+static unsigned long hp_wmi_sensors_updated;
+static bool hp_wmi_sensors_valid;
+static unsigned int hp_wmi_update_interval = 2000;
+static int hp_wmi_fan_rpm[HPWMI_FAN_COUNT];
+static int hp_wmi_temp[HPWMI_TEMP_COUNT];
+static struct device *hp_wmi_hwmon_dev;
+
+static const char * const hp_wmi_sensor_labels[] = {
+  "CPU", "GPU",
+};
 
-struct color_platform {
-  u8 blue;
-  u8 green;
-  u8 red;
-} __packed;
+/* Caller must hold hp_wmi_sensors_lock */
+static void hp_wmi_sensors_refresh(void)
+{
+  u8 data[HPWMI_SENSOR_DATA_SIZE];
+  u8 *args, gpu_temp;
+  int i, ret;
 
-struct platform_zone {
-  u8 offset;
-  struct device_attribute *attr;
-  struct color_platform colors;
-};
+  if (hp_wmi_sensors_valid &&
+      time_before(jiffies, hp_wmi_sensors_updated +
+            msecs_to_jiffies(hp_wmi_update_interval)))
+    return;
 
-static struct device_attribute *zone_dev_attrs;
-static struct attribute **zone_attrs;
-static struct platform_zone *zone_data;
+  args = hp_wmi_query_begin();
 
-static struct attribute_group zone_attribute_group = {
-  .name = "rgb_zones",
-};
+  /* Fan levels come in units of 100 rpm, one byte per fan */
+  memset(args, 0, sizeof(u32));
+  ret = hp_wmi_perform_query_locked(HPWMI_FAN_SPEED_GET_QUERY, HPWMI_GM,
+            sizeof(u32), data, sizeof(data));
+  for (i = 0; i < HPWMI_FAN_COUNT; i++)
+    hp_wmi_fan_rpm[i] = ret ? -EIO : data[i] * 100;
 
-/*
- * Helpers used for zone control
- */
-static int parse_rgb(const char *buf, struct platform_zone *zone)
-{
-  long unsigned int rgb;
-  int ret;
-  union color_union {
-    struct color_platform cp;
-    int package;
-  } repackager;
+  memset(args, 0, sizeof(u32));
+  ret = hp_wmi_perform_query_locked(HPWMI_TEMPERATURE_GET_QUERY, HPWMI_GM,
+            sizeof(u32), data, sizeof(u32));
+  hp_wmi_temp[0] = ret ? -EIO : data[0] * 1000;
 
-  ret = kstrtoul(buf, 16, &rgb);
-  if (ret)
-    return ret;
+  hp_wmi_query_end();
 
-  /* RGB triplet notation is 24-bit hexadecimal */
-  if (rgb > 0xFFFFFF)
-    return -EINVAL;
+  ret = ec_read(HPWMI_OMEN_EC_GPU_TEMP, &gpu_temp);
+  hp_wmi_temp[1] = ret ? ret : gpu_temp * 1000;
 
-  repackager.package = rgb;
-  pr_debug("hp-wmi: r:%d g:%d b:%d\n",
-     repackager.cp.red, repackager.cp.green, repackager.cp.blue);
-  zone->colors = repackager.cp;
-  return 0;
+  hp_wmi_sensors_updated = jiffies;
+  hp_wmi_sensors_valid = true;
 }
 
-static struct platform_zone *match_zone(struct device_attribute *attr)
+static umode_t hp_wmi_hwmon_is_visible(const void *data,
+               enum hwmon_sensor_types type,
+               u32 attr, int channel)
 {
-  u8 zone;
-
-  for (zone = 0; zone < FOURZONE_COUNT; zone++) {
-    if ((struct device_attribute *)zone_data[zone].attr == attr) {
-      pr_debug("hp-wmi: matched zone location: %d\n",
-         zone_data[zone].offset);
-      return &zone_data[zone];
-    }
+  switch (type) {
+  case hwmon_chip:
+    return 0644;
+  case hwmon_fan:
+    return hp_wmi_fan_rpm[channel] < 0 ? 0 : 0444;
+  case hwmon_temp:
+    return hp_wmi_temp[channel] < 0 ? 0 : 0444;
+  default:
+    return 0;
   }
-  return NULL;
 }
 
-/*
- * Individual RGB zone control
- */
-static int fourzone_update_led(struct platform_zone *zone, enum hp_wmi_command read_or_write)
+static int hp_wmi_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
+           u32 attr, int channel, long *val)
 {
-  u8 state[128];
-
-  int ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_GET, HPWMI_FOURZONE, &state,
-    sizeof(state), sizeof(state));
+  int ret;
 
-  if (ret) {
-    pr_warn("fourzone_color_get returned error 0x%x\n", ret);
-    return ret <= 0 ? ret : -EINVAL;
+  if (type == hwmon_chip) {
+    *val = READ_ONCE(hp_wmi_update_interval);
+    return 0;
   }
 
-  if (read_or_write == HPWMI_WRITE) {
-    // Zones start at offset 25. Wonder what's in the rest of the buffer?
-    state[zone->offset + 0] = zone->colors.red;
-    state[zone->offset + 1] = zone->colors.green;
-    state[zone->offset + 2] = zone->colors.blue;
-
-    ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_SET, HPWMI_FOURZONE, &state,
-            sizeof(state), sizeof(state));
+  mutex_lock(&hp_wmi_sensors_lock);
+  hp_wmi_sensors_refresh();
+  ret = type == hwmon_fan ? hp_wmi_fan_rpm[channel] : hp_wmi_temp[channel];
+  mutex_unlock(&hp_wmi_sensors_lock);
 
-    if (ret)
-      pr_warn("fourzone_color_set returned error 0x%x\n", ret);
+  if (ret < 0)
     return ret;
 
-  } else {
-      zone->colors.red = state[zone->offset + 0];
-      zone->colors.green = state[zone->offset + 1];
-      zone->colors.blue = state[zone->offset + 2];
-  }
+  *val = ret;
   return 0;
 }
 
-static ssize_t zone_show(struct device *dev, struct device_attribute *attr,
-       char *buf)
+static int hp_wmi_hwmon_read_string(struct device *dev,
+            enum hwmon_sensor_types type,
+            u32 attr, int channel, const char **str)
 {
-  struct platform_zone *target_zone;
-  int ret;
-
-  target_zone = match_zone(attr);
-  if (target_zone == NULL)
-    return sprintf(buf, "red: -1, green: -1, blue: -1\n");
-
-  ret = fourzone_update_led(target_zone, HPWMI_READ);
+  *str = hp_wmi_sensor_labels[channel];
+  return 0;
+}
 
+static int hp_wmi_hwmon_write(struct device *dev, enum hwmon_sensor_types type,
+            u32 attr, int channel, long val)
+{
+  WRITE_ONCE(hp_wmi_update_interval, clamp_val(val, 0, 60000));
+  return 0;
+}
+
+static const struct hwmon_channel_info * const hp_wmi_hwmon_info[] = {
+  HWMON_CHANNEL_INFO(chip, HWMON_C_UPDATE_INTERVAL),
+  HWMON_CHANNEL_INFO(fan,
+         HWMON_F_INPUT | HWMON_F_LABEL,
+         HWMON_F_INPUT | HWMON_F_LABEL),
+  HWMON_CHANNEL_INFO(temp,
+         HWMON_T_INPUT | HWMON_T_LABEL,
+         HWMON_T_INPUT | HWMON_T_LABEL),
+  NULL
+};
+
+static const struct hwmon_ops hp_wmi_hwmon_ops = {
+  .is_visible = hp_wmi_hwmon_is_visible,
+  .read = hp_wmi_hwmon_read,
+  .read_string = hp_wmi_hwmon_read_string,
+  .write = hp_wmi_hwmon_write,
+};
+
+static const struct hwmon_chip_info hp_wmi_hwmon_chip_info = {
+  .ops = &hp_wmi_hwmon_ops,
+  .info = hp_wmi_hwmon_info,
+};
+
+static void hp_wmi_hwmon_setup(struct platform_device *device)
+{
+  int i;
+
+  /* Sample once up front; channels the firmware refuses stay hidden */
+  mutex_lock(&hp_wmi_sensors_lock);
+  hp_wmi_sensors_refresh();
+  mutex_unlock(&hp_wmi_sensors_lock);
+
+  for (i = 0; i < HPWMI_FAN_COUNT; i++)
+    if (hp_wmi_fan_rpm[i] >= 0)
+      break;
+  if (i == HPWMI_FAN_COUNT &&
+      hp_wmi_temp[0] < 0 && hp_wmi_temp[1] < 0)
+    return;
+
+  hp_wmi_hwmon_dev = hwmon_device_register_with_info(&device->dev, "hp",
+                 NULL,
+                 &hp_wmi_hwmon_chip_info,
+                 NULL);
+  if (IS_ERR(hp_wmi_hwmon_dev)) {
+    pr_warn("failed to register hwmon device\n");
+    hp_wmi_hwmon_dev = NULL;
+  }
+}
+
+static void hp_wmi_hwmon_remove(void)
+{
+  if (hp_wmi_hwmon_dev) {
+    hwmon_device_unregister(hp_wmi_hwmon_dev);
+    hp_wmi_hwmon_dev = NULL;
+  }
+}
+
+/* System design data, read once at probe */
+#define OMEN_DESIGN_DATA_SIZE 8
+#define OMEN_DESIGN_THERMAL_POLICY 3
+#define OMEN_DESIGN_DEFAULT_PL4 5
+
+static u8 omen_design_data[OMEN_DESIGN_DATA_SIZE];
+static bool omen_design_data_valid;
+
+static void omen_design_data_setup(void)
+{
+  omen_design_data_valid =
+    !hp_wmi_perform_query(HPWMI_GET_SYSTEM_DESIGN_DATA, HPWMI_GM,
+              omen_design_data, sizeof(omen_design_data),
+              sizeof(omen_design_data));
+}
+
+/*
+ * Omen thermal policy
+ *
+ * The policy is set through a GM call but only read back from an EC
+ * register. Boards with thermal policy version 0 use different codes
+ * for the same three modes than later ones.
+ */
+#define HPWMI_OMEN_EC_THERMAL_PROFILE 0x95
+
+enum omen_thermal_mode {
+  OMEN_THERMAL_DEFAULT,
+  OMEN_THERMAL_PERFORMANCE,
+  OMEN_THERMAL_COOL,
+  OMEN_THERMAL_COUNT
+};
+
+static const u8 omen_thermal_codes[][OMEN_THERMAL_COUNT] = {
+  { 0x00, 0x01, 0x02 },
+  { 0x30, 0x31, 0x50 },
+};
+
+static const enum platform_profile_option omen_thermal_profiles[OMEN_THERMAL_COUNT] = {
+  [OMEN_THERMAL_DEFAULT] = PLATFORM_PROFILE_BALANCED,
+  [OMEN_THERMAL_PERFORMANCE] = PLATFORM_PROFILE_PERFORMANCE,
+  [OMEN_THERMAL_COOL] = PLATFORM_PROFILE_QUIET,
+};
+
+static const u8 *omen_thermal_table;
+static struct platform_profile_handler omen_profile_handler;
+static bool omen_profile_registered;
+
+static int omen_thermal_get(void)
+{
+  u8 code;
+  int mode, ret;
+
+  ret = ec_read(HPWMI_OMEN_EC_THERMAL_PROFILE, &code);
+  if (ret)
+    return ret;
+
+  for (mode = 0; mode < OMEN_THERMAL_COUNT; mode++)
+    if (omen_thermal_table[mode] == code)
+      return mode;
+
+  return -EINVAL;
+}
+
+static int omen_thermal_set(enum omen_thermal_mode mode)
+{
+  /* The vendor tool always sends 0xFF as the first byte, do the same */
+  u8 buffer[2] = { 0xFF, omen_thermal_table[mode] };
+  int ret;
+
+  ret = hp_wmi_perform_query(HPWMI_SET_PERFORMANCE_MODE, HPWMI_GM,
+           buffer, sizeof(buffer), 0);
+  if (ret)
+    return ret < 0 ? ret : -EINVAL;
+
+  return 0;
+}
+
+static int omen_profile_get(struct platform_profile_handler *pprof,
+          enum platform_profile_option *profile)
+{
+  int mode = omen_thermal_get();
+
+  if (mode < 0)
+    return mode;
+
+  *profile = omen_thermal_profiles[mode];
+  return 0;
+}
+
+static int omen_profile_set(struct platform_profile_handler *pprof,
+          enum platform_profile_option profile)
+{
+  int mode;
+
+  for (mode = 0; mode < OMEN_THERMAL_COUNT; mode++)
+    if (omen_thermal_profiles[mode] == profile)
+      return omen_thermal_set(mode);
+
+  return -EOPNOTSUPP;
+}
+
+static void omen_profile_setup(void)
+{
+  int version, mode;
+
+  if (!omen_design_data_valid)
+    return;
+  version = omen_design_data[OMEN_DESIGN_THERMAL_POLICY];
+  if (version >= ARRAY_SIZE(omen_thermal_codes))
+    return;
+  omen_thermal_table = omen_thermal_codes[version];
+
+  /* Only take over if the current policy reads back as one we know */
+  mode = omen_thermal_get();
+  if (mode < 0)
+    return;
+  pr_info("thermal policy v%d, current mode %d\n", version, mode);
+
+  for (mode = 0; mode < OMEN_THERMAL_COUNT; mode++)
+    set_bit(omen_thermal_profiles[mode], omen_profile_handler.choices);
+  omen_profile_handler.profile_get = omen_profile_get;
+  omen_profile_handler.profile_set = omen_profile_set;
+
+  if (platform_profile_register(&omen_profile_handler))
+    pr_warn("failed to register platform profile\n");
+  else
+    omen_profile_registered = true;
+}
+
+static void omen_profile_remove(void)
+{
+  if (omen_profile_registered) {
+    platform_profile_remove();
+    omen_profile_registered = false;
+  }
+}
+
+/*
+ * Power limits
+ *
+ * The firmware takes the CPU's sustained (PL1), boost (PL2) and peak
+ * (PL4) limits in whole watts but has no call to read them back, so the
+ * cpu_pl* attributes report what was last applied; 0 hands a limit back
+ * to the firmware default. Writes are checked against the default PL4
+ * from the system design data. The design data has no lower bound, so
+ * writes below OMEN_POWER_LIMIT_MIN are refused: the firmware applies
+ * any value it is given, and a limit of a few watts throttles the CPU
+ * hard enough to stall the machine. The GPU's configurable TGP and
+ * Dynamic Boost switches are read back from the firmware.
+ */
+#define OMEN_POWER_LIMIT_DEFAULT 0x00
+#define OMEN_POWER_LIMIT_NO_CHANGE 0xFF
+/* Lowest sustained power of any mobile CPU class, in watts */
+#define OMEN_POWER_LIMIT_MIN 15
+
+enum omen_power_limit {
+  OMEN_PL1,
+  OMEN_PL2,
+  OMEN_PL4,
+  OMEN_PL_COUNT
+};
+
+struct omen_power_limits {
+  u8 pl1;
+  u8 pl2;
+  u8 pl4;
+  u8 cpu_gpu_concurrent_limit;
+} __packed;
+
+struct omen_gpu_power_modes {
+  u8 ctgp_enable;
+  u8 ppab_enable;
+  u8 dstate;
+  u8 gpu_slowdown_temp;
+} __packed;
+
+static DEFINE_MUTEX(omen_power_lock);
+static u8 omen_power_limits[OMEN_PL_COUNT];
+static u8 omen_power_max;
+static bool omen_gpu_modes_supported;
+static bool omen_power_registered;
+
+/* PL1 <= PL2 <= PL4, ignoring limits left at the firmware default */
+static bool omen_power_limits_valid(const u8 *limits)
+{
+  u8 floor = 0;
+  int i;
+
+  for (i = 0; i < OMEN_PL_COUNT; i++) {
+    if (limits[i] == OMEN_POWER_LIMIT_DEFAULT)
+      continue;
+    if (limits[i] < floor)
+      return false;
+    floor = limits[i];
+  }
+  return true;
+}
+
+static ssize_t omen_power_limit_store(enum omen_power_limit index,
+              const char *buf, size_t count)
+{
+  struct omen_power_limits args;
+  u8 limits[OMEN_PL_COUNT];
+  u8 value;
+  int ret;
+
+  ret = kstrtou8(buf, 10, &value);
+  if (ret)
+    return ret;
+  if (value > omen_power_max)
+    return -ERANGE;
+  if (value != OMEN_POWER_LIMIT_DEFAULT && value < OMEN_POWER_LIMIT_MIN)
+    return -ERANGE;
+
+  mutex_lock(&omen_power_lock);
+  memcpy(limits, omen_power_limits, sizeof(limits));
+  limits[index] = value;
+  if (!omen_power_limits_valid(limits)) {
+    ret = -EINVAL;
+    goto out;
+  }
+
+  args.pl1 = limits[OMEN_PL1];
+  args.pl2 = limits[OMEN_PL2];
+  args.pl4 = limits[OMEN_PL4];
+  args.cpu_gpu_concurrent_limit = OMEN_POWER_LIMIT_NO_CHANGE;
+  ret = hp_wmi_perform_query(HPWMI_SET_POWER_LIMITS_QUERY, HPWMI_GM,
+           &args, sizeof(args), 0);
+  if (ret) {
+    ret = ret < 0 ? ret : -EINVAL;
+    goto out;
+  }
+  memcpy(omen_power_limits, limits, sizeof(limits));
+
+out:
+  mutex_unlock(&omen_power_lock);
+  return ret ? ret : count;
+}
+
+static ssize_t cpu_pl1_show(struct device *dev, struct device_attribute *attr,
+          char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(omen_power_limits[OMEN_PL1]));
+}
+
+static ssize_t cpu_pl1_store(struct device *dev, struct device_attribute *attr,
+           const char *buf, size_t count)
+{
+  return omen_power_limit_store(OMEN_PL1, buf, count);
+}
+
+static ssize_t cpu_pl2_show(struct device *dev, struct device_attribute *attr,
+          char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(omen_power_limits[OMEN_PL2]));
+}
+
+static ssize_t cpu_pl2_store(struct device *dev, struct device_attribute *attr,
+           const char *buf, size_t count)
+{
+  return omen_power_limit_store(OMEN_PL2, buf, count);
+}
+
+static ssize_t cpu_pl4_show(struct device *dev, struct device_attribute *attr,
+          char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(omen_power_limits[OMEN_PL4]));
+}
+
+static ssize_t cpu_pl4_store(struct device *dev, struct device_attribute *attr,
+           const char *buf, size_t count)
+{
+  return omen_power_limit_store(OMEN_PL4, buf, count);
+}
+
+static ssize_t cpu_pl_min_show(struct device *dev, struct device_attribute *attr,
+             char *buf)
+{
+  return sprintf(buf, "%u\n", OMEN_POWER_LIMIT_MIN);
+}
+
+static ssize_t cpu_pl_max_show(struct device *dev, struct device_attribute *attr,
+             char *buf)
+{
+  return sprintf(buf, "%u\n", omen_power_max);
+}
+
+static int omen_gpu_modes_get(struct omen_gpu_power_modes *modes)
+{
+  int ret;
+
+  memset(modes, 0, sizeof(*modes));
+  ret = hp_wmi_perform_query(HPWMI_GET_GPU_THERMAL_MODES_QUERY, HPWMI_GM,
+           modes, sizeof(*modes), sizeof(*modes));
+  if (ret)
+    return ret < 0 ? ret : -EINVAL;
+  return 0;
+}
+
+static ssize_t omen_gpu_mode_show(size_t field, char *buf)
+{
+  struct omen_gpu_power_modes modes;
+  int ret;
+
+  ret = omen_gpu_modes_get(&modes);
+  if (ret)
+    return ret;
+  return sprintf(buf, "%u\n", !!((u8 *)&modes)[field]);
+}
+
+/* Read-modify-write, so the other switches keep their firmware values */
+static ssize_t omen_gpu_mode_store(size_t field, const char *buf, size_t count)
+{
+  struct omen_gpu_power_modes modes;
+  bool value;
+  int ret;
+
+  ret = kstrtobool(buf, &value);
+  if (ret)
+    return ret;
+
+  mutex_lock(&omen_power_lock);
+  ret = omen_gpu_modes_get(&modes);
+  if (!ret) {
+    ((u8 *)&modes)[field] = value;
+    ret = hp_wmi_perform_query(HPWMI_SET_GPU_THERMAL_MODES_QUERY, HPWMI_GM,
+             &modes, sizeof(modes), 0);
+    if (ret > 0)
+      ret = -EINVAL;
+  }
+  mutex_unlock(&omen_power_lock);
+
+  return ret ? ret : count;
+}
+
+static ssize_t gpu_ctgp_show(struct device *dev, struct device_attribute *attr,
+           char *buf)
+{
+  return omen_gpu_mode_show(offsetof(struct omen_gpu_power_modes, ctgp_enable), buf);
+}
+
+static ssize_t gpu_ctgp_store(struct device *dev, struct device_attribute *attr,
+            const char *buf, size_t count)
+{
+  return omen_gpu_mode_store(offsetof(struct omen_gpu_power_modes, ctgp_enable),
+           buf, count);
+}
+
+static ssize_t gpu_ppab_show(struct device *dev, struct device_attribute *attr,
+           char *buf)
+{
+  return omen_gpu_mode_show(offsetof(struct omen_gpu_power_modes, ppab_enable), buf);
+}
+
+static ssize_t gpu_ppab_store(struct device *dev, struct device_attribute *attr,
+            const char *buf, size_t count)
+{
+  return omen_gpu_mode_store(offsetof(struct omen_gpu_power_modes, ppab_enable),
+           buf, count);
+}
+
+static DEVICE_ATTR_RW(cpu_pl1);
+static DEVICE_ATTR_RW(cpu_pl2);
+static DEVICE_ATTR_RW(cpu_pl4);
+static DEVICE_ATTR_RO(cpu_pl_min);
+static DEVICE_ATTR_RO(cpu_pl_max);
+static DEVICE_ATTR_RW(gpu_ctgp);
+static DEVICE_ATTR_RW(gpu_ppab);
+
+static struct attribute *omen_power_attrs[] = {
+  &dev_attr_cpu_pl1.attr,
+  &dev_attr_cpu_pl2.attr,
+  &dev_attr_cpu_pl4.attr,
+  &dev_attr_cpu_pl_min.attr,
+  &dev_attr_cpu_pl_max.attr,
+  &dev_attr_gpu_ctgp.attr,
+  &dev_attr_gpu_ppab.attr,
+  NULL
+};
+
+static umode_t omen_power_attr_visible(struct kobject *kobj,
+               struct attribute *attr, int n)
+{
+  if (attr == &dev_attr_gpu_ctgp.attr || attr == &dev_attr_gpu_ppab.attr)
+    return omen_gpu_modes_supported ? attr->mode : 0;
+
+  return omen_power_max ? attr->mode : 0;
+}
+
+static const struct attribute_group omen_power_group = {
+  .name = "power_limits",
+  .attrs = omen_power_attrs,
+  .is_visible = omen_power_attr_visible,
+};
+
+static void omen_power_setup(struct platform_device *device)
+{
+  struct omen_gpu_power_modes modes;
+
+  if (omen_design_data_valid)
+    omen_power_max = omen_design_data[OMEN_DESIGN_DEFAULT_PL4];
+  omen_gpu_modes_supported = !omen_gpu_modes_get(&modes);
+
+  if (!omen_power_max && !omen_gpu_modes_supported)
+    return;
+
+  if (sysfs_create_group(&device->dev.kobj, &omen_power_group))
+    pr_warn("failed to create power limit attributes\n");
+  else
+    omen_power_registered = true;
+}
+
+static void omen_power_remove(struct platform_device *device)
+{
+  if (omen_power_registered) {
+    sysfs_remove_group(&device->dev.kobj, &omen_power_group);
+    omen_power_registered = false;
+  }
+}
+
+/*
+ * Fan max boost
+ *
+ * Runs both fans at full speed. With fan_max_timeout set, the firmware
+ * is handed back automatic control that many seconds after the boost was
+ * switched on, so a job that dies halfway does not leave the machine at
+ * full noise.
+ */
+#define FAN_MAX_TIMEOUT_MAX (24 * 60 * 60)
+
+static DEFINE_MUTEX(fan_max_lock);
+static unsigned int fan_max_timeout;
+/* A revert is due, under fan_max_lock */
+static bool fan_max_armed;
+static bool fan_max_registered;
+static void fan_max_revert(struct work_struct *work);
+static DECLARE_DELAYED_WORK(fan_max_work, fan_max_revert);
+
+static int fan_max_get(void)
+{
+  int val = 0, ret;
+
+  ret = hp_wmi_perform_query(HPWMI_FAN_SPEED_MAX_GET_QUERY, HPWMI_GM,
+           &val, sizeof(val), sizeof(val));
+  if (ret)
+    return ret < 0 ? ret : -EINVAL;
+
+  return val;
+}
+
+static int fan_max_set(bool enable)
+{
+  u32 val = enable;
+  int ret;
+
+  ret = hp_wmi_perform_query(HPWMI_FAN_SPEED_MAX_SET_QUERY, HPWMI_GM,
+           &val, sizeof(val), 0);
+  if (ret)
+    return ret < 0 ? ret : -EINVAL;
+
+  return 0;
+}
+
+static void fan_max_revert(struct work_struct *work)
+{
+  mutex_lock(&fan_max_lock);
+  /*
+   * A store while this waited for the lock either disarmed the revert
+   * or queued a new one, and that boost must stay on
+   */
+  if (fan_max_armed && !delayed_work_pending(&fan_max_work)) {
+    fan_max_armed = false;
+    if (fan_max_set(false))
+      pr_warn("failed to hand fan control back to the firmware\n");
+  }
+  mutex_unlock(&fan_max_lock);
+}
+
+static ssize_t fan_max_show(struct device *dev, struct device_attribute *attr,
+          char *buf)
+{
+  int value = fan_max_get();
+
+  if (value < 0)
+    return value;
+  return sprintf(buf, "%d\n", !!value);
+}
+
+static ssize_t fan_max_store(struct device *dev, struct device_attribute *attr,
+           const char *buf, size_t count)
+{
+  unsigned int timeout;
+  bool enable;
+  int ret;
+
+  ret = kstrtobool(buf, &enable);
+  if (ret)
+    return ret;
+
+  mutex_lock(&fan_max_lock);
+  ret = fan_max_set(enable);
+  timeout = READ_ONCE(fan_max_timeout);
+  if (!ret) {
+    fan_max_armed = enable && timeout;
+    if (fan_max_armed)
+      mod_delayed_work(system_wq, &fan_max_work, msecs_to_jiffies(timeout * MSEC_PER_SEC));
+    else
+      cancel_delayed_work(&fan_max_work);
+  }
+  mutex_unlock(&fan_max_lock);
+
+  return ret ? ret : count;
+}
+
+static ssize_t fan_max_timeout_show(struct device *dev,
+            struct device_attribute *attr, char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(fan_max_timeout));
+}
+
+/* Takes effect the next time the boost is switched on */
+static ssize_t fan_max_timeout_store(struct device *dev,
+             struct device_attribute *attr,
+             const char *buf, size_t count)
+{
+  unsigned int timeout;
+  int ret;
+
+  ret = kstrtouint(buf, 10, &timeout);
+  if (ret)
+    return ret;
+  if (timeout > FAN_MAX_TIMEOUT_MAX)
+    return -ERANGE;
+
+  WRITE_ONCE(fan_max_timeout, timeout);
+  return count;
+}
+
+static DEVICE_ATTR_RW(fan_max);
+static DEVICE_ATTR_RW(fan_max_timeout);
+
+static struct attribute *fan_max_attrs[] = {
+  &dev_attr_fan_max.attr,
+  &dev_attr_fan_max_timeout.attr,
+  NULL
+};
+
+static const struct attribute_group fan_max_group = {
+  .attrs = fan_max_attrs,
+};
+
+static void fan_max_setup(struct platform_device *device)
+{
+  if (fan_max_get() < 0)
+    return;
+
+  if (sysfs_create_group(&device->dev.kobj, &fan_max_group))
+    pr_warn("failed to create fan boost attributes\n");
+  else
+    fan_max_registered = true;
+}
+
+static void fan_max_remove(struct platform_device *device)
+{
+  if (!fan_max_registered)
+    return;
+
+  sysfs_remove_group(&device->dev.kobj, &fan_max_group);
+  fan_max_registered = false;
+
+  /* Do not leave a pending revert behind */
+  if (cancel_delayed_work_sync(&fan_max_work))
+    fan_max_revert(NULL);
+}
+
+/* Support for the HP Omen FourZone keyboard lighting */
+
+#define FOURZONE_COUNT 4
+#define FOURZONE_STATE_SIZE 128
+
+struct color_platform {
+  u8 blue;
+  u8 green;
+  u8 red;
+} __packed;
+
+struct platform_zone {
+  u8 offset;
+  struct device_attribute *attr;
+  struct color_platform colors;
+};
+
+static struct device_attribute *zone_dev_attrs;
+static struct attribute **zone_attrs;
+static struct platform_zone *zone_data;
+
+static struct attribute_group zone_attribute_group = {
+  .name = "rgb_zones",
+};
+
+/*
+ * Helpers used for zone control
+ */
+static int parse_rgb_value(const char *buf, struct color_platform *colors)
+{
+  long unsigned int rgb;
+  int ret;
+  union color_union {
+    struct color_platform cp;
+    int package;
+  } repackager;
+
+  ret = kstrtoul(buf, 16, &rgb);
+  if (ret)
+    return ret;
+
+  /* RGB triplet notation is 24-bit hexadecimal */
+  if (rgb > 0xFFFFFF)
+    return -EINVAL;
+
+  repackager.package = rgb;
+  pr_debug("hp-wmi: r:%d g:%d b:%d\n",
+     repackager.cp.red, repackager.cp.green, repackager.cp.blue);
+  *colors = repackager.cp;
+  return 0;
+}
+
+static struct platform_zone *match_zone(struct device_attribute *attr)
+{
+  u8 zone;
+
+  for (zone = 0; zone < FOURZONE_COUNT; zone++) {
+    if ((struct device_attribute *)zone_data[zone].attr == attr) {
+      pr_debug("hp-wmi: matched zone location: %d\n",
+         zone_data[zone].offset);
+      return &zone_data[zone];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Raw access to the 128 byte FourZone state buffer
+ */
+static int fourzone_get_state(u8 *state)
+{
+  int ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_GET, HPWMI_FOURZONE, state,
+    FOURZONE_STATE_SIZE, FOURZONE_STATE_SIZE);
+
+  if (ret) {
+    pr_warn("fourzone_color_get returned error 0x%x\n", ret);
+    return ret <= 0 ? ret : -EINVAL;
+  }
+  return 0;
+}
+
+/* Caller must hold hp_wmi_query_lock, with the state built in place */
+static int fourzone_set_state_locked(void)
+{
+  int ret = hp_wmi_perform_query_locked(HPWMI_FOURZONE_COLOR_SET, HPWMI_FOURZONE,
+    FOURZONE_STATE_SIZE, NULL, FOURZONE_STATE_SIZE);
+
+  if (ret) {
+    pr_warn("fourzone_color_set returned error 0x%x\n", ret);
+    return ret <= 0 ? ret : -EINVAL;
+  }
+  return 0;
+}
+
+/*
+ * Shadow copy of the firmware state buffer. It is loaded once and then
+ * kept in sync with every successful COLOR_SET, so reads never have to
+ * enter firmware and writes don't need a COLOR_GET first.
+ */
+static u8 fourzone_state[FOURZONE_STATE_SIZE];
+static bool fourzone_state_valid;
+static DECLARE_RWSEM(fourzone_lock);
+
+/* Running average of how long a COLOR_SET takes, used for frame pacing */
+static u64 fourzone_set_latency_ns;
+
+/* Caller must hold fourzone_lock for writing */
+static int fourzone_refresh_state(void)
+{
+  int ret;
+
+  if (fourzone_state_valid)
+    return 0;
+
+  ret = fourzone_get_state(fourzone_state);
+  if (!ret)
+    fourzone_state_valid = true;
+  return ret;
+}
+
+/* Caller must hold fourzone_lock for writing */
+static void fourzone_invalidate_state(void)
+{
+  fourzone_state_valid = false;
+}
+
+/*
+ * Takes fourzone_lock for reading with a valid shadow, loading it from
+ * firmware first if needed. Returns with the lock released on error.
+ */
+static int fourzone_read_lock(void)
+{
+  int ret;
+
+  down_read(&fourzone_lock);
+  if (likely(fourzone_state_valid))
+    return 0;
+  up_read(&fourzone_lock);
+
+  down_write(&fourzone_lock);
+  ret = fourzone_refresh_state();
+  downgrade_write(&fourzone_lock);
+  if (ret)
+    up_read(&fourzone_lock);
+  return ret;
+}
+
+/*
+ * Frames are built straight in the firmware argument buffer: begin hands
+ * it out prefilled with the shadow state, commit pushes it and releases
+ * it again. Caller must hold fourzone_lock for writing, with a valid
+ * shadow.
+ */
+static u8 *fourzone_begin_state(void)
+{
+  u8 *state = hp_wmi_query_begin();
+
+  memcpy(state, fourzone_state, FOURZONE_STATE_SIZE);
+  return state;
+}
+
+/* The SET is skipped if the frame matches what the firmware already has */
+static int fourzone_commit_state(u8 *state)
+{
+  ktime_t start;
+  u64 latency;
+  int ret = 0;
+
+  if (fourzone_state_valid && !memcmp(state, fourzone_state, FOURZONE_STATE_SIZE))
+    goto out;
+
+  start = ktime_get();
+  ret = fourzone_set_state_locked();
+  latency = ktime_to_ns(ktime_sub(ktime_get(), start));
+  WRITE_ONCE(fourzone_set_latency_ns,
+       fourzone_set_latency_ns ? (fourzone_set_latency_ns * 7 + latency) / 8 : latency);
+  if (ret) {
+    fourzone_invalidate_state();
+    goto out;
+  }
+
+  memcpy(fourzone_state, state, FOURZONE_STATE_SIZE);
+  fourzone_state_valid = true;
+out:
+  hp_wmi_query_end();
+  return ret;
+}
+
+static void fourzone_pack_color(u8 *state, u8 offset, struct color_platform colors)
+{
+  // Zones start at offset 25. Wonder what's in the rest of the buffer?
+  state[offset + 0] = colors.red;
+  state[offset + 1] = colors.green;
+  state[offset + 2] = colors.blue;
+}
+
+static struct color_platform fourzone_unpack_color(u8 *state, u8 offset)
+{
+  struct color_platform colors = {
+    .red = state[offset + 0],
+    .green = state[offset + 1],
+    .blue = state[offset + 2],
+  };
+
+  return colors;
+}
+
+/*
+ * Current colour of every zone, as the firmware has it. zone_data holds
+ * the colours that were asked for, which differ while an effect runs.
+ */
+static int fourzone_read_colors(struct color_platform *colors)
+{
+  u8 zone;
+  int ret;
+
+  ret = fourzone_read_lock();
+  if (ret)
+    return ret;
+  for (zone = 0; zone < FOURZONE_COUNT; zone++)
+    colors[zone] = fourzone_unpack_color(fourzone_state, zone_data[zone].offset);
+  up_read(&fourzone_lock);
+  return 0;
+}
+
+static bool fourzone_effect_active(void);
+
+#define FOURZONE_ALL_ZONES (BIT(FOURZONE_COUNT) - 1)
+
+/*
+ * Pushes the requested colours of the zones in @zones with a single SET,
+ * so a frame never shows up half-applied. While an effect runs, the
+ * requested colours only become the base of the next frame. Caller must
+ * hold fourzone_lock for writing.
+ */
+static int fourzone_apply_zones(unsigned long zones)
+{
+  unsigned int zone;
+  u8 *state;
+  int ret;
+
+  if (fourzone_effect_active())
+    return 0;
+
+  ret = fourzone_refresh_state();
+  if (ret)
+    return ret;
+
+  state = fourzone_begin_state();
+  for_each_set_bit(zone, &zones, FOURZONE_COUNT)
+    fourzone_pack_color(state, zone_data[zone].offset, zone_data[zone].colors);
+  return fourzone_commit_state(state);
+}
+
+static int fourzone_update_all(void)
+{
+  int ret;
+
+  down_write(&fourzone_lock);
+  ret = fourzone_apply_zones(FOURZONE_ALL_ZONES);
+  up_write(&fourzone_lock);
+  return ret;
+}
+
+/*
+ * Host driven lighting effects
+ *
+ * The firmware only knows static colours, so effects are rendered here:
+ * every tick composites all zones into one state buffer and pushes it
+ * with a single COLOR_SET. Intensities are Q16 fixed point, 0x10000 being
+ * full scale. Frames are never scheduled faster than twice the measured
+ * COLOR_SET latency, so slow firmware gets a lower frame rate rather
+ * than a backlog.
+ */
+enum fourzone_effect {
+  FOURZONE_EFFECT_NONE,
+  FOURZONE_EFFECT_BREATHING,
+  FOURZONE_EFFECT_CYCLE,
+  FOURZONE_EFFECT_WAVE,
+};
+
+static const char * const fourzone_effect_names[] = {
+  [FOURZONE_EFFECT_NONE] = "none",
+  [FOURZONE_EFFECT_BREATHING] = "breathing",
+  [FOURZONE_EFFECT_CYCLE] = "cycle",
+  [FOURZONE_EFFECT_WAVE] = "wave",
+};
+
+#define FOURZONE_FP_ONE 0x10000
+
+static DEFINE_MUTEX(effect_lock);
+static enum fourzone_effect effect_mode;
+static unsigned int effect_period_ms = 3000;
+static unsigned int effect_max_fps = 30;
+static ktime_t effect_start;
+static void fourzone_effect_tick(struct work_struct *work);
+static DECLARE_DELAYED_WORK(effect_work, fourzone_effect_tick);
+
+static bool fourzone_effect_active(void)
+{
+  return READ_ONCE(effect_mode) != FOURZONE_EFFECT_NONE;
+}
+
+static u8 fourzone_lerp(u8 from, u8 to, u32 t)
+{
+  return from + (((int)(to - from) * (int)t) >> 16);
+}
+
+/* Fully saturated colour for a Q16 hue, interpolated between primaries */
+static struct color_platform fourzone_hue(u32 hue)
+{
+  struct color_platform colors = { 0 };
+  u32 pos = (hue & (FOURZONE_FP_ONE - 1)) * 6;
+  u32 frac = pos & (FOURZONE_FP_ONE - 1);
+  u8 up = fourzone_lerp(0, 0xFF, frac);
+  u8 down = 0xFF - up;
+
+  switch (pos >> 16) {
+  case 0: colors.red = 0xFF; colors.green = up; break;
+  case 1: colors.red = down; colors.green = 0xFF; break;
+  case 2: colors.green = 0xFF; colors.blue = up; break;
+  case 3: colors.green = down; colors.blue = 0xFF; break;
+  case 4: colors.red = up; colors.blue = 0xFF; break;
+  default: colors.red = 0xFF; colors.blue = down; break;
+  }
+  return colors;
+}
+
+/* Colour of @zone at @phase (Q16) of the current effect period */
+static struct color_platform fourzone_effect_color(u8 zone, u32 phase)
+{
+  struct color_platform base = zone_data[zone].colors;
+  struct color_platform black = { 0 };
+  u32 level;
+
+  switch (effect_mode) {
+  case FOURZONE_EFFECT_BREATHING:
+    /* Triangle wave from black up to the base colour and back */
+    level = phase < FOURZONE_FP_ONE / 2 ? phase * 2 :
+      (FOURZONE_FP_ONE - 1 - phase) * 2;
+    black.red = fourzone_lerp(0, base.red, level);
+    black.green = fourzone_lerp(0, base.green, level);
+    black.blue = fourzone_lerp(0, base.blue, level);
+    return black;
+  case FOURZONE_EFFECT_CYCLE:
+    return fourzone_hue(phase);
+  case FOURZONE_EFFECT_WAVE:
+    return fourzone_hue(phase + zone * (FOURZONE_FP_ONE / FOURZONE_COUNT));
+  default:
+    return base;
+  }
+}
+
+/* Caller must hold effect_lock */
+static u64 fourzone_effect_interval_ns(void)
+{
+  u64 frame_ns = div_u64(NSEC_PER_SEC, effect_max_fps);
+
+  return max(frame_ns, 2 * READ_ONCE(fourzone_set_latency_ns));
+}
+
+static void fourzone_effect_tick(struct work_struct *work)
+{
+  u8 *state;
+  u64 period_ns, elapsed_ns, rem;
+  u32 phase;
+  u8 zone;
+  int ret;
+
+  mutex_lock(&effect_lock);
+  if (effect_mode == FOURZONE_EFFECT_NONE) {
+    mutex_unlock(&effect_lock);
+    return;
+  }
+
+  period_ns = (u64)effect_period_ms * NSEC_PER_MSEC;
+  elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), effect_start));
+  div64_u64_rem(elapsed_ns, period_ns, &rem);
+  phase = div64_u64(rem << 16, period_ns);
+
+  down_write(&fourzone_lock);
+  ret = fourzone_refresh_state();
+  if (!ret) {
+    state = fourzone_begin_state();
+    for (zone = 0; zone < FOURZONE_COUNT; zone++)
+      fourzone_pack_color(state, zone_data[zone].offset,
+              fourzone_effect_color(zone, phase));
+    ret = fourzone_commit_state(state);
+  }
+  up_write(&fourzone_lock);
+
+  if (ret)
+    pr_warn_ratelimited("lighting effect frame failed: %d\n", ret);
+
+  schedule_delayed_work(&effect_work,
+            nsecs_to_jiffies(fourzone_effect_interval_ns()));
+  mutex_unlock(&effect_lock);
+}
+
+/*
+ * Serializes mode changes, so stopping an effect cannot cancel the first
+ * tick of one started meanwhile. The tick only takes effect_lock, which
+ * is why cancel_delayed_work_sync() is fine under this lock.
+ */
+static DEFINE_MUTEX(effect_set_lock);
+
+static int fourzone_effect_set(enum fourzone_effect mode)
+{
+  int ret = 0;
+
+  mutex_lock(&effect_set_lock);
+  mutex_lock(&effect_lock);
+  WRITE_ONCE(effect_mode, mode);
+  if (mode != FOURZONE_EFFECT_NONE) {
+    effect_start = ktime_get();
+    mod_delayed_work(system_wq, &effect_work, 0);
+  }
+  mutex_unlock(&effect_lock);
+
+  if (mode == FOURZONE_EFFECT_NONE) {
+    /* Back to the static colours */
+    cancel_delayed_work_sync(&effect_work);
+    ret = fourzone_update_all();
+  }
+  mutex_unlock(&effect_set_lock);
+
+  return ret;
+}
+
+/*
+ * Write-behind queue for zone colours
+ *
+ * Writers only record the colour they want and return. A single work
+ * item picks up everything queued so far and applies it with one SET,
+ * the last colour written to a zone wins. This also serializes all zone
+ * writers, which used to race in the read-modify-write of the state
+ * buffer. Queueing never sleeps, so it is usable from atomic context.
+ */
+static DEFINE_SPINLOCK(fourzone_pending_lock);
+static unsigned long fourzone_pending;
+static struct color_platform fourzone_pending_colors[FOURZONE_COUNT];
+static int fourzone_flush_error;
+/* Set across suspend, the workers then leave queued colours for resume */
+static bool fourzone_suspended;
+static void fourzone_flush_fn(struct work_struct *work);
+static DECLARE_WORK(fourzone_flush_work, fourzone_flush_fn);
+
+static void fourzone_queue_colors(unsigned long zones,
+          const struct color_platform *colors)
+{
+  unsigned long flags;
+  unsigned int zone;
+
+  spin_lock_irqsave(&fourzone_pending_lock, flags);
+  for_each_set_bit(zone, &zones, FOURZONE_COUNT)
+    fourzone_pending_colors[zone] = colors[zone];
+  fourzone_pending |= zones;
+  spin_unlock_irqrestore(&fourzone_pending_lock, flags);
+
+  schedule_work(&fourzone_flush_work);
+}
+
+static void fourzone_flush_fn(struct work_struct *work)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  unsigned long flags, zones;
+  unsigned int zone;
+  int ret;
+
+  if (READ_ONCE(fourzone_suspended))
+    return;
+
+  spin_lock_irqsave(&fourzone_pending_lock, flags);
+  zones = fourzone_pending;
+  fourzone_pending = 0;
+  memcpy(colors, fourzone_pending_colors, sizeof(colors));
+  spin_unlock_irqrestore(&fourzone_pending_lock, flags);
+
+  if (!zones)
+    return;
+
+  down_write(&fourzone_lock);
+  for_each_set_bit(zone, &zones, FOURZONE_COUNT)
+    zone_data[zone].colors = colors[zone];
+  ret = fourzone_apply_zones(zones);
+  up_write(&fourzone_lock);
+
+  if (ret)
+    WRITE_ONCE(fourzone_flush_error, ret);
+}
+
+/* Waits for queued colours to reach the firmware */
+static int fourzone_sync(void)
+{
+  flush_work(&fourzone_flush_work);
+  return xchg(&fourzone_flush_error, 0);
+}
+
+static ssize_t zone_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  struct platform_zone *target_zone;
+  int ret;
+
+  target_zone = match_zone(attr);
+  if (target_zone == NULL)
+    return sprintf(buf, "red: -1, green: -1, blue: -1\n");
+
+  ret = fourzone_read_colors(colors);
+
+  if (ret)
+    return sprintf(buf, "red: -1, green: -1, blue: -1\n");
+
+  return sprintf(buf, "red: %d, green: %d, blue: %d\n",
+           colors[target_zone - zone_data].red,
+           colors[target_zone - zone_data].green,
+           colors[target_zone - zone_data].blue);
+
+}
+
+static ssize_t zone_set(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  struct platform_zone *target_zone;
+  u8 zone;
+  int ret;
+  target_zone = match_zone(attr);
+  if (target_zone == NULL) {
+    pr_err("hp-wmi: invalid target zone\n");
+    return 1;
+  }
+  zone = target_zone - zone_data;
+  ret = parse_rgb_value(buf, &colors[zone]);
   if (ret)
-    return sprintf(buf, "red: -1, green: -1, blue: -1\n");
+    return ret;
+  fourzone_queue_colors(BIT(zone), colors);
+  return count;
+}
+
+static ssize_t all_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  ssize_t len = 0;
+  u8 zone;
+  int ret;
+
+  ret = fourzone_read_colors(colors);
+  if (ret)
+    return ret;
+
+  for (zone = 0; zone < FOURZONE_COUNT; zone++)
+    len += sprintf(buf + len, "%02X%02X%02X%c",
+             colors[zone].red,
+             colors[zone].green,
+             colors[zone].blue,
+             zone == FOURZONE_COUNT - 1 ? '\n' : ' ');
+  return len;
+}
+
+/*
+ * Takes one hex colour per zone, separated by whitespace, e.g.
+ * "FF0000 00FF00 0000FF FFFFFF". A single colour is applied to every zone.
+ */
+static ssize_t all_set(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  char *tmp, *cur, *tok;
+  int ret = 0, n = 0;
+  u8 zone;
+
+  tmp = kstrndup(buf, count, GFP_KERNEL);
+  if (!tmp)
+    return -ENOMEM;
+
+  cur = tmp;
+  while ((tok = strsep(&cur, " \t\n")) != NULL) {
+    if (!*tok)
+      continue;
+    if (n == FOURZONE_COUNT) {
+      ret = -EINVAL;
+      break;
+    }
+    ret = parse_rgb_value(tok, &colors[n++]);
+    if (ret)
+      break;
+  }
+  kfree(tmp);
+
+  if (!ret && n != 1 && n != FOURZONE_COUNT)
+    ret = -EINVAL;
+  if (ret)
+    return ret;
+
+  for (zone = 1; n == 1 && zone < FOURZONE_COUNT; zone++)
+    colors[zone] = colors[0];
+
+  fourzone_queue_colors(FOURZONE_ALL_ZONES, colors);
+  return count;
+}
+
+static DEVICE_ATTR(all, 0644, all_show, all_set);
+
+/*
+ * Zone writes return before the firmware has the new colours; writing
+ * to sync waits for them and reports a failed write, if any.
+ */
+static ssize_t sync_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  int ret = fourzone_sync();
+
+  return ret ? ret : count;
+}
+
+static DEVICE_ATTR_WO(sync);
+
+/*
+ * Raw zone colours: red, green and blue bytes for every zone, in the
+ * layout the firmware uses from offset 25 of the state buffer. Writes
+ * must cover whole zones and are applied with a single SET.
+ */
+#define FOURZONE_RAW_SIZE (FOURZONE_COUNT * 3)
+
+static ssize_t colors_read(struct file *filp, struct kobject *kobj,
+         struct bin_attribute *attr, char *buf,
+         loff_t off, size_t count)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  u8 raw[FOURZONE_RAW_SIZE];
+  u8 zone;
+  int ret;
+
+  ret = fourzone_read_colors(colors);
+  if (ret)
+    return ret;
+
+  for (zone = 0; zone < FOURZONE_COUNT; zone++)
+    fourzone_pack_color(raw, zone * 3, colors[zone]);
+
+  memcpy(buf, raw + off, count);
+  return count;
+}
+
+static ssize_t colors_write(struct file *filp, struct kobject *kobj,
+          struct bin_attribute *attr, char *buf,
+          loff_t off, size_t count)
+{
+  struct color_platform colors[FOURZONE_COUNT];
+  unsigned long zones = 0;
+  u8 zone;
+  int ret;
+
+  if (off % 3 || count % 3)
+    return -EINVAL;
+
+  for (zone = off / 3; zone < (off + count) / 3; zone++) {
+    colors[zone] = fourzone_unpack_color((u8 *)buf, zone * 3 - off);
+    zones |= BIT(zone);
+  }
+
+  fourzone_queue_colors(zones, colors);
+  ret = fourzone_sync();
+  return ret ? ret : count;
+}
+
+static BIN_ATTR_RW(colors, FOURZONE_RAW_SIZE);
+
+static struct bin_attribute *fourzone_bin_attrs[] = {
+  &bin_attr_colors,
+  NULL
+};
+
+static int fourzone_anim_stop(void);
+
+static ssize_t effect_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  return sprintf(buf, "%s\n", fourzone_effect_names[READ_ONCE(effect_mode)]);
+}
+
+static ssize_t effect_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  int mode, ret;
+
+  mode = sysfs_match_string(fourzone_effect_names, buf);
+  if (mode < 0)
+    return mode;
+
+  if (mode != FOURZONE_EFFECT_NONE) {
+    ret = fourzone_anim_stop();
+    if (ret)
+      return ret;
+  }
+
+  ret = fourzone_effect_set(mode);
+  return ret ? ret : count;
+}
+
+/* Length of one effect cycle in milliseconds */
+static ssize_t effect_period_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(effect_period_ms));
+}
+
+static ssize_t effect_period_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  unsigned int period;
+  int ret;
+
+  ret = kstrtouint(buf, 10, &period);
+  if (ret)
+    return ret;
+  if (period < 100 || period > 60000)
+    return -EINVAL;
+
+  mutex_lock(&effect_lock);
+  effect_period_ms = period;
+  mutex_unlock(&effect_lock);
+  return count;
+}
+
+static ssize_t effect_max_fps_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(effect_max_fps));
+}
+
+static ssize_t effect_max_fps_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  unsigned int fps;
+  int ret;
+
+  ret = kstrtouint(buf, 10, &fps);
+  if (ret)
+    return ret;
+  if (fps < 1 || fps > 60)
+    return -EINVAL;
+
+  mutex_lock(&effect_lock);
+  effect_max_fps = fps;
+  mutex_unlock(&effect_lock);
+  return count;
+}
+
+/* Frame rate actually used, after capping to the firmware latency */
+static ssize_t effect_fps_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  u64 frame_ns;
+
+  mutex_lock(&effect_lock);
+  frame_ns = fourzone_effect_interval_ns();
+  mutex_unlock(&effect_lock);
+
+  return sprintf(buf, "%llu\n", div64_u64(NSEC_PER_SEC, frame_ns));
+}
+
+static DEVICE_ATTR_RW(effect);
+static DEVICE_ATTR_RW(effect_period);
+static DEVICE_ATTR_RW(effect_max_fps);
+static DEVICE_ATTR_RO(effect_fps);
+
+/*
+ * Firmware animations
+ *
+ * Besides static colours the firmware can run a few animations on its
+ * own, at no cost to the host. The animation table read by ANIM_GET
+ * starts with the mode, speed, direction and colour set; the rest of
+ * the table is not understood and is written back unchanged.
+ */
+#define FOURZONE_ANIM_MODE 0
+#define FOURZONE_ANIM_SPEED 1
+#define FOURZONE_ANIM_DIRECTION 2
+#define FOURZONE_ANIM_COLOR_COUNT 3
+#define FOURZONE_ANIM_COLORS 4
+#define FOURZONE_ANIM_MAX_COLORS 4
+#define FOURZONE_ANIM_MAX_SPEED 2
+
+static const char * const fourzone_anim_modes[] = {
+  "off", "breathing", "cycle", "wave",
+};
+
+static const char * const fourzone_anim_directions[] = {
+  "left", "right",
+};
+
+static u8 fourzone_anim[FOURZONE_STATE_SIZE];
+static bool fourzone_anim_supported;
+static DEFINE_MUTEX(fourzone_anim_lock);
+
+/* Caller must hold fourzone_anim_lock */
+/* The request is built in place, so the SET reply never overwrites anim */
+static int fourzone_anim_commit(u8 *anim)
+{
+  int ret;
+
+  memcpy(hp_wmi_query_begin(), anim, FOURZONE_STATE_SIZE);
+  ret = hp_wmi_perform_query_locked(HPWMI_FOURZONE_ANIM_SET, HPWMI_FOURZONE,
+            FOURZONE_STATE_SIZE, NULL,
+            FOURZONE_STATE_SIZE);
+  hp_wmi_query_end();
+  if (ret) {
+    pr_warn("fourzone_anim_set returned error 0x%x\n", ret);
+    return ret < 0 ? ret : -EINVAL;
+  }
+
+  memcpy(fourzone_anim, anim, FOURZONE_STATE_SIZE);
+  return 0;
+}
+
+/* Changes one byte of the animation table */
+static int fourzone_anim_set_field(u8 field, u8 value)
+{
+  u8 anim[FOURZONE_STATE_SIZE];
+  int ret = 0;
+
+  mutex_lock(&fourzone_anim_lock);
+  if (fourzone_anim[field] != value) {
+    memcpy(anim, fourzone_anim, FOURZONE_STATE_SIZE);
+    anim[field] = value;
+    ret = fourzone_anim_commit(anim);
+  }
+  mutex_unlock(&fourzone_anim_lock);
+  return ret;
+}
+
+/* Hands the keyboard back to static colours (or host effects) */
+static int fourzone_anim_stop(void)
+{
+  if (!fourzone_anim_supported)
+    return 0;
+  return fourzone_anim_set_field(FOURZONE_ANIM_MODE, 0);
+}
+
+static ssize_t anim_mode_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  u8 mode = READ_ONCE(fourzone_anim[FOURZONE_ANIM_MODE]);
+
+  if (mode >= ARRAY_SIZE(fourzone_anim_modes))
+    return sprintf(buf, "%u\n", mode);
+  return sprintf(buf, "%s\n", fourzone_anim_modes[mode]);
+}
+
+static ssize_t anim_mode_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  int mode, ret;
+
+  mode = sysfs_match_string(fourzone_anim_modes, buf);
+  if (mode < 0)
+    return mode;
+
+  /* Host and firmware animations would fight over the keyboard */
+  if (mode) {
+    ret = fourzone_effect_set(FOURZONE_EFFECT_NONE);
+    if (ret)
+      return ret;
+  }
+
+  ret = fourzone_anim_set_field(FOURZONE_ANIM_MODE, mode);
+  return ret ? ret : count;
+}
+
+static ssize_t anim_speed_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  return sprintf(buf, "%u\n", READ_ONCE(fourzone_anim[FOURZONE_ANIM_SPEED]));
+}
+
+static ssize_t anim_speed_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  u8 speed;
+  int ret;
+
+  ret = kstrtou8(buf, 10, &speed);
+  if (ret)
+    return ret;
+  if (speed > FOURZONE_ANIM_MAX_SPEED)
+    return -EINVAL;
+
+  ret = fourzone_anim_set_field(FOURZONE_ANIM_SPEED, speed);
+  return ret ? ret : count;
+}
+
+static ssize_t anim_direction_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  u8 direction = READ_ONCE(fourzone_anim[FOURZONE_ANIM_DIRECTION]);
+
+  if (direction >= ARRAY_SIZE(fourzone_anim_directions))
+    return sprintf(buf, "%u\n", direction);
+  return sprintf(buf, "%s\n", fourzone_anim_directions[direction]);
+}
+
+static ssize_t anim_direction_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  int direction, ret;
+
+  direction = sysfs_match_string(fourzone_anim_directions, buf);
+  if (direction < 0)
+    return direction;
+
+  ret = fourzone_anim_set_field(FOURZONE_ANIM_DIRECTION, direction);
+  return ret ? ret : count;
+}
+
+static ssize_t anim_colors_show(struct device *dev, struct device_attribute *attr,
+       char *buf)
+{
+  struct color_platform colors;
+  ssize_t len = 0;
+  u8 i, n;
+
+  mutex_lock(&fourzone_anim_lock);
+  n = min_t(u8, fourzone_anim[FOURZONE_ANIM_COLOR_COUNT], FOURZONE_ANIM_MAX_COLORS);
+  for (i = 0; i < n; i++) {
+    colors = fourzone_unpack_color(fourzone_anim, FOURZONE_ANIM_COLORS + i * 3);
+    len += sprintf(buf + len, "%02X%02X%02X ",
+             colors.red, colors.green, colors.blue);
+  }
+  mutex_unlock(&fourzone_anim_lock);
+
+  if (len)
+    buf[len - 1] = '\n';
+  else
+    len = sprintf(buf, "\n");
+  return len;
+}
+
+/* Takes up to FOURZONE_ANIM_MAX_COLORS hex colours, separated by whitespace */
+static ssize_t anim_colors_store(struct device *dev, struct device_attribute *attr,
+      const char *buf, size_t count)
+{
+  struct color_platform colors[FOURZONE_ANIM_MAX_COLORS];
+  u8 anim[FOURZONE_STATE_SIZE];
+  char *tmp, *cur, *tok;
+  int ret = 0, n = 0, i;
+
+  tmp = kstrndup(buf, count, GFP_KERNEL);
+  if (!tmp)
+    return -ENOMEM;
+
+  cur = tmp;
+  while ((tok = strsep(&cur, " \t\n")) != NULL) {
+    if (!*tok)
+      continue;
+    if (n == FOURZONE_ANIM_MAX_COLORS) {
+      ret = -EINVAL;
+      break;
+    }
+    ret = parse_rgb_value(tok, &colors[n++]);
+    if (ret)
+      break;
+  }
+  kfree(tmp);
+
+  if (!ret && !n)
+    ret = -EINVAL;
+  if (ret)
+    return ret;
+
+  mutex_lock(&fourzone_anim_lock);
+  memcpy(anim, fourzone_anim, FOURZONE_STATE_SIZE);
+  anim[FOURZONE_ANIM_COLOR_COUNT] = n;
+  for (i = 0; i < n; i++)
+    fourzone_pack_color(anim, FOURZONE_ANIM_COLORS + i * 3, colors[i]);
+  ret = fourzone_anim_commit(anim);
+  mutex_unlock(&fourzone_anim_lock);
+
+  return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(anim_mode);
+static DEVICE_ATTR_RW(anim_speed);
+static DEVICE_ATTR_RW(anim_direction);
+static DEVICE_ATTR_RW(anim_colors);
+
+static void fourzone_anim_setup(void)
+{
+  int ret;
+
+  mutex_lock(&fourzone_anim_lock);
+  ret = hp_wmi_perform_query(HPWMI_FOURZONE_ANIM_GET, HPWMI_FOURZONE, fourzone_anim,
+           FOURZONE_STATE_SIZE, FOURZONE_STATE_SIZE);
+  fourzone_anim_supported = !ret;
+  mutex_unlock(&fourzone_anim_lock);
+}
+
+static struct attribute *fourzone_common_attrs[] = {
+  &dev_attr_all.attr,
+  &dev_attr_sync.attr,
+  &dev_attr_effect.attr,
+  &dev_attr_effect_period.attr,
+  &dev_attr_effect_max_fps.attr,
+  &dev_attr_effect_fps.attr,
+  &dev_attr_anim_mode.attr,
+  &dev_attr_anim_speed.attr,
+  &dev_attr_anim_direction.attr,
+  &dev_attr_anim_colors.attr,
+  NULL
+};
+
+static umode_t fourzone_attr_visible(struct kobject *kobj,
+             struct attribute *attr, int n)
+{
+  if ((attr == &dev_attr_anim_mode.attr ||
+       attr == &dev_attr_anim_speed.attr ||
+       attr == &dev_attr_anim_direction.attr ||
+       attr == &dev_attr_anim_colors.attr) && !fourzone_anim_supported)
+    return 0;
+
+  return attr->mode;
+}
+
+/*
+ * Keyboard backlight
+ *
+ * The firmware only switches the backlight on and off. brightness_set
+ * may be called from atomic context (e.g. by triggers), so it only
+ * records the value; a work item applies the latest one, coalescing
+ * anything set in between. The work and firmware-reported changes both
+ * update kbd_backlight_applied, so they serialize on kbd_backlight_lock.
+ */
+#define FOURZONE_BACKLIGHT_ON 0xE4
+#define FOURZONE_BACKLIGHT_OFF 0x64
+
+static DEFINE_MUTEX(kbd_backlight_lock);
+static enum led_brightness kbd_backlight_brightness;
+static int kbd_backlight_applied = -1;
+static bool kbd_backlight_registered;
+static void kbd_backlight_work_fn(struct work_struct *work);
+static DECLARE_WORK(kbd_backlight_work, kbd_backlight_work_fn);
+
+static int kbd_backlight_get_hw(void)
+{
+  u8 state[4] = { 0 };
+  int ret;
+
+  ret = hp_wmi_perform_query(HPWMI_FOURZONE_BRIGHT_GET, HPWMI_FOURZONE, &state,
+           sizeof(state), sizeof(state));
+  if (ret)
+    return ret < 0 ? ret : -EINVAL;
 
-  return sprintf(buf, "red: %d, green: %d, blue: %d\n",
-           target_zone->colors.red,
-           target_zone->colors.green, target_zone->colors.blue);
+  return state[0] == FOURZONE_BACKLIGHT_ON;
+}
+
+static void kbd_backlight_work_fn(struct work_struct *work)
+{
+  u8 state[4] = { 0 };
+  int value, ret;
+
+  if (READ_ONCE(fourzone_suspended))
+    return;
+
+  mutex_lock(&kbd_backlight_lock);
+  value = READ_ONCE(kbd_backlight_brightness) ? 1 : 0;
+  if (value == kbd_backlight_applied)
+    goto out;
+
+  state[0] = value ? FOURZONE_BACKLIGHT_ON : FOURZONE_BACKLIGHT_OFF;
+  ret = hp_wmi_perform_query(HPWMI_FOURZONE_BRIGHT_SET, HPWMI_FOURZONE, &state,
+           sizeof(state), 0);
+  if (ret) {
+    pr_warn("fourzone_bright_set returned error 0x%x\n", ret);
+    kbd_backlight_applied = -1;
+    goto out;
+  }
+  kbd_backlight_applied = value;
 
+out:
+  mutex_unlock(&kbd_backlight_lock);
 }
 
-static ssize_t zone_set(struct device *dev, struct device_attribute *attr,
-      const char *buf, size_t count)
+static void kbd_backlight_set(struct led_classdev *led_cdev,
+         enum led_brightness brightness)
 {
-  struct platform_zone *target_zone;
-  int ret;
-  target_zone = match_zone(attr);
-  if (target_zone == NULL) {
-    pr_err("hp-wmi: invalid target zone\n");
-    return 1;
+  WRITE_ONCE(kbd_backlight_brightness, brightness);
+  schedule_work(&kbd_backlight_work);
+}
+
+static enum led_brightness kbd_backlight_get(struct led_classdev *led_cdev)
+{
+  return READ_ONCE(kbd_backlight_brightness);
+}
+
+static struct led_classdev kbd_backlight = {
+  .name = "hp-omen::kbd_backlight",
+  .max_brightness = 1,
+  .brightness_set = kbd_backlight_set,
+  .brightness_get = kbd_backlight_get,
+  .flags = LED_BRIGHT_HW_CHANGED | LED_RETAIN_AT_SHUTDOWN,
+};
+
+/* The firmware changed the backlight by itself, e.g. from a hotkey */
+static void kbd_backlight_hw_changed(void)
+{
+  int value;
+
+  if (!kbd_backlight_registered)
+    return;
+
+  mutex_lock(&kbd_backlight_lock);
+  value = kbd_backlight_get_hw();
+  if (value >= 0) {
+    WRITE_ONCE(kbd_backlight_brightness, value);
+    kbd_backlight_applied = value;
   }
-  ret = parse_rgb(buf, target_zone);
-  if (ret)
-    return ret;
-  ret = fourzone_update_led(target_zone, HPWMI_WRITE);
-  return ret ? ret : count;
+  mutex_unlock(&kbd_backlight_lock);
+
+  if (value >= 0)
+    led_classdev_notify_brightness_hw_changed(&kbd_backlight, value);
 }
 
 /*
-static void global_led_set(struct led_classdev *led_cdev,
-         enum led_brightness brightness)
+ * Multicolor LED per zone
+ *
+ * Each zone is also registered as a multicolor LED, so kernel LED
+ * triggers can drive it. Like the sysfs attributes, the LEDs only queue
+ * their colour for the write-behind worker, which keeps brightness_set
+ * non-blocking and merges updates of several zones into one SET.
+ */
+struct fourzone_led {
+  struct led_classdev_mc mc;
+  struct mc_subled subleds[3];
+  char name[32];
+  u8 zone;
+  bool registered;
+};
+
+static struct fourzone_led fourzone_leds[FOURZONE_COUNT];
+
+static void fourzone_led_set(struct led_classdev *led_cdev,
+           enum led_brightness brightness)
+{
+  struct led_classdev_mc *mc = lcdev_to_mccdev(led_cdev);
+  struct fourzone_led *led = container_of(mc, struct fourzone_led, mc);
+  struct color_platform colors[FOURZONE_COUNT];
+
+  led_mc_calc_color_components(mc, brightness);
+  colors[led->zone].red = led->subleds[0].brightness;
+  colors[led->zone].green = led->subleds[1].brightness;
+  colors[led->zone].blue = led->subleds[2].brightness;
+  fourzone_queue_colors(BIT(led->zone), colors);
+}
+
+static void fourzone_leds_setup(struct platform_device *dev)
+{
+  struct fourzone_led *led;
+  u8 zone;
+
+  for (zone = 0; zone < FOURZONE_COUNT; zone++) {
+    led = &fourzone_leds[zone];
+    led->zone = zone;
+    snprintf(led->name, sizeof(led->name), "hp-omen:rgb:kbd_zone%u", zone);
+
+    led->subleds[0].color_index = LED_COLOR_ID_RED;
+    led->subleds[0].intensity = zone_data[zone].colors.red;
+    led->subleds[1].color_index = LED_COLOR_ID_GREEN;
+    led->subleds[1].intensity = zone_data[zone].colors.green;
+    led->subleds[2].color_index = LED_COLOR_ID_BLUE;
+    led->subleds[2].intensity = zone_data[zone].colors.blue;
+
+    led->mc.led_cdev.name = led->name;
+    led->mc.led_cdev.max_brightness = 0xFF;
+    led->mc.led_cdev.brightness = 0xFF;
+    led->mc.led_cdev.brightness_set = fourzone_led_set;
+    led->mc.led_cdev.flags = LED_RETAIN_AT_SHUTDOWN;
+    led->mc.num_colors = ARRAY_SIZE(led->subleds);
+    led->mc.subled_info = led->subleds;
+
+    if (led_classdev_multicolor_register(&dev->dev, &led->mc))
+      pr_warn("failed to register LED for zone %u\n", zone);
+    else
+      led->registered = true;
+  }
+}
+
+static void fourzone_leds_remove(void)
+{
+  u8 zone;
+
+  for (zone = 0; zone < FOURZONE_COUNT; zone++) {
+    if (!fourzone_leds[zone].registered)
+      continue;
+    led_classdev_multicolor_unregister(&fourzone_leds[zone].mc);
+    fourzone_leds[zone].registered = false;
+  }
+}
+
+/*
+ * Lighting framebuffer
+ *
+ * /dev/hp-omen-lighting lets a renderer in userspace draw straight into
+ * an mmap'ed buffer and commit finished frames with an ioctl (see
+ * hp-omen.h). A commit only snapshots the buffer into the one pending
+ * frame and kicks a worker, so the producer never waits for the
+ * firmware; a frame that gets replaced before the worker picked it up is
+ * counted as dropped.
+ *
+ * Open files outlive an unbind, so lighting_fb is cleared under both
+ * lighting_fb_lock and lighting_lock before it is freed, and the file
+ * operations check it under one of them.
+ */
+static u8 *lighting_fb;
+static DEFINE_MUTEX(lighting_fb_lock);
+static DEFINE_SPINLOCK(lighting_lock);
+static u8 lighting_frame[FOURZONE_RAW_SIZE];
+static u32 lighting_frame_seq;
+static bool lighting_frame_pending;
+static struct hp_omen_lighting_stats lighting_stats;
+static bool lighting_registered;
+static void lighting_work_fn(struct work_struct *work);
+static DECLARE_WORK(lighting_work, lighting_work_fn);
+
+static void lighting_work_fn(struct work_struct *work)
 {
+  u8 frame[FOURZONE_RAW_SIZE];
+  bool skipped;
+  u32 seq;
+  u8 zone;
   int ret;
-  global_brightness = brightness;
-  ret = alienware_update_led(&zone_data[0]);
-  if (ret)
-    pr_err("LED brightness update failed\n");
+
+  if (READ_ONCE(fourzone_suspended))
+    return;
+
+  spin_lock(&lighting_lock);
+  if (!lighting_frame_pending) {
+    spin_unlock(&lighting_lock);
+    return;
+  }
+  memcpy(frame, lighting_frame, sizeof(frame));
+  seq = lighting_frame_seq;
+  lighting_frame_pending = false;
+  spin_unlock(&lighting_lock);
+
+  down_write(&fourzone_lock);
+  for (zone = 0; zone < FOURZONE_COUNT; zone++)
+    zone_data[zone].colors = fourzone_unpack_color(frame, zone * 3);
+  /* A running host effect owns the keyboard, the frame stays unwritten */
+  skipped = fourzone_effect_active();
+  ret = skipped ? 0 : fourzone_apply_zones(FOURZONE_ALL_ZONES);
+  up_write(&fourzone_lock);
+
+  if (ret) {
+    pr_warn_ratelimited("lighting frame %u failed: %d\n", seq, ret);
+    return;
+  }
+
+  spin_lock(&lighting_lock);
+  if (skipped) {
+    lighting_stats.skipped++;
+  } else {
+    lighting_stats.written++;
+    lighting_stats.last_seq = seq;
+  }
+  spin_unlock(&lighting_lock);
+}
+
+static long lighting_ioctl(struct file *file, unsigned int cmd,
+         unsigned long arg)
+{
+  void __user *argp = (void __user *)arg;
+  struct hp_omen_lighting_info info;
+  struct hp_omen_lighting_stats stats;
+  u32 seq;
+
+  switch (cmd) {
+  case HP_OMEN_LIGHTING_GET_INFO:
+    info.zone_count = FOURZONE_COUNT;
+    info.fb_size = FOURZONE_RAW_SIZE;
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+
+  case HP_OMEN_LIGHTING_COMMIT:
+    if (get_user(seq, (u32 __user *)argp))
+      return -EFAULT;
+
+    spin_lock(&lighting_lock);
+    if (!lighting_fb) {
+      spin_unlock(&lighting_lock);
+      return -ENODEV;
+    }
+    memcpy(lighting_frame, lighting_fb, sizeof(lighting_frame));
+    if (lighting_frame_pending)
+      lighting_stats.dropped++;
+    lighting_frame_pending = true;
+    lighting_frame_seq = seq;
+    lighting_stats.committed++;
+    /* Queued under the lock, so the cancel in remove catches it */
+    schedule_work(&lighting_work);
+    spin_unlock(&lighting_lock);
+    return 0;
+
+  case HP_OMEN_LIGHTING_GET_STATS:
+    spin_lock(&lighting_lock);
+    stats = lighting_stats;
+    spin_unlock(&lighting_lock);
+    return copy_to_user(argp, &stats, sizeof(stats)) ? -EFAULT : 0;
+  }
+
+  return -ENOTTY;
 }
 
-static enum led_brightness global_led_get(struct led_classdev *led_cdev)
+static int lighting_mmap(struct file *file, struct vm_area_struct *vma)
 {
-  return global_brightness;
+  int ret = -ENODEV;
+
+  /* Frames drawn into private copies would never reach the commit */
+  if (!(vma->vm_flags & VM_SHARED))
+    return -EINVAL;
+
+  mutex_lock(&lighting_fb_lock);
+  if (lighting_fb)
+    ret = remap_vmalloc_range(vma, lighting_fb, vma->vm_pgoff);
+  mutex_unlock(&lighting_fb_lock);
+
+  return ret;
 }
 
-static struct led_classdev global_led = {
-  .brightness_set = global_led_set,
-  .brightness_get = global_led_get,
-  .name = "hp-omen::global_brightness",
+static const struct file_operations lighting_fops = {
+  .owner = THIS_MODULE,
+  .unlocked_ioctl = lighting_ioctl,
+  .compat_ioctl = compat_ptr_ioctl,
+  .mmap = lighting_mmap,
+  .llseek = noop_llseek,
 };
-*/
 
-// static DEVICE_ATTR(lighting_control_state, 0644, show_control_state,
-// 		   store_control_state);
+static struct miscdevice lighting_miscdev = {
+  .minor = MISC_DYNAMIC_MINOR,
+  .name = "hp-omen-lighting",
+  .fops = &lighting_fops,
+};
+
+static void fourzone_lighting_setup(void)
+{
+  u8 zone;
+
+  lighting_fb = vmalloc_user(PAGE_SIZE);
+  if (!lighting_fb)
+    return;
+
+  for (zone = 0; zone < FOURZONE_COUNT; zone++)
+    fourzone_pack_color(lighting_fb, zone * 3, zone_data[zone].colors);
+
+  if (misc_register(&lighting_miscdev)) {
+    pr_warn("failed to register the lighting device\n");
+    vfree(lighting_fb);
+    lighting_fb = NULL;
+    return;
+  }
+  lighting_registered = true;
+}
+
+static void fourzone_lighting_remove(void)
+{
+  u8 *fb;
+
+  if (!lighting_registered)
+    return;
+
+  misc_deregister(&lighting_miscdev);
+  lighting_registered = false;
+
+  /* Files still open get -ENODEV from here on */
+  mutex_lock(&lighting_fb_lock);
+  spin_lock(&lighting_lock);
+  fb = lighting_fb;
+  lighting_fb = NULL;
+  lighting_frame_pending = false;
+  spin_unlock(&lighting_lock);
+  mutex_unlock(&lighting_fb_lock);
+
+  cancel_work_sync(&lighting_work);
+  vfree(fb);
+}
 
 static int fourzone_setup(struct platform_device *dev)
 {
   u8 zone;
+  int ret;
   char buffer[10];
   char *name;
 
   if (!quirks->fourzone)
     return 0;
-
-  // global_led.max_brightness = 0x0F;
-  // global_brightness = global_led.max_brightness;
+  if (quirks->zones != FOURZONE_COUNT) {
+    pr_info("%u zone keyboards are not supported\n", quirks->zones);
+    quirks->fourzone = false;
+    return 0;
+  }
 
   /*
    *      - zone_dev_attrs num_zones + 1 is for individual zones and then
    *        null terminated
-   *      - zone_attrs num_zones + 2 is for all attrs in zone_dev_attrs +
-   *        the lighting control + null terminated
+   *      - zone_attrs is for all attrs in zone_dev_attrs +
+   *        fourzone_common_attrs, which brings its own null terminator
    *      - zone_data num_zones is for the distinct zones
    */
 
@@ -1099,7 +3933,8 @@ static int fourzone_setup(struct platform_device *dev)
     return -ENOMEM;
 
   zone_attrs =
-      kcalloc(FOURZONE_COUNT + 1 /* 2 */, sizeof(struct attribute *),
+      kcalloc(FOURZONE_COUNT + ARRAY_SIZE(fourzone_common_attrs),
+        sizeof(struct attribute *),
         GFP_KERNEL);
   if (!zone_attrs)
     return -ENOMEM;
@@ -1124,18 +3959,132 @@ static int fourzone_setup(struct platform_device *dev)
     zone_attrs[zone] = &zone_dev_attrs[zone].attr;
     zone_data[zone].attr = &zone_dev_attrs[zone];
   }
-  // zone_attrs[FOURZONE_COUNT] = &dev_attr_lighting_control_state.attr;
+  memcpy(&zone_attrs[FOURZONE_COUNT], fourzone_common_attrs,
+         sizeof(fourzone_common_attrs));
   zone_attribute_group.attrs = zone_attrs;
+  zone_attribute_group.is_visible = fourzone_attr_visible;
+  zone_attribute_group.bin_attrs = fourzone_bin_attrs;
+
+  fourzone_anim_setup();
+
+  ret = kbd_backlight_get_hw();
+  if (ret >= 0) {
+    kbd_backlight_brightness = ret;
+    kbd_backlight_applied = ret;
+    kbd_backlight_registered = !led_classdev_register(&dev->dev, &kbd_backlight);
+  }
+
+  /* Start out with whatever the firmware has */
+  down_write(&fourzone_lock);
+  if (!fourzone_refresh_state())
+    for (zone = 0; zone < FOURZONE_COUNT; zone++)
+      zone_data[zone].colors = fourzone_unpack_color(fourzone_state,
+                       zone_data[zone].offset);
+  up_write(&fourzone_lock);
 
-//  led_classdev_register(&dev->dev, &global_led);
+  fourzone_leds_setup(dev);
+  fourzone_lighting_setup();
 
   return sysfs_create_group(&dev->dev.kobj, &zone_attribute_group);
 }
 
-static int __init hp_wmi_bios_setup(struct platform_device *device)
+static void fourzone_free(void)
+{
+  int zone;
+
+  if (zone_dev_attrs)
+    for (zone = 0; zone < FOURZONE_COUNT; zone++)
+      kfree(zone_dev_attrs[zone].attr.name);
+  kfree(zone_dev_attrs);
+  kfree(zone_attrs);
+  kfree(zone_data);
+  zone_dev_attrs = NULL;
+  zone_attrs = NULL;
+  zone_data = NULL;
+}
+
+static void fourzone_remove(struct platform_device *dev)
 {
+  if (!quirks->fourzone || !zone_data) {
+    fourzone_free();
+    return;
+  }
+
+  sysfs_remove_group(&dev->dev.kobj, &zone_attribute_group);
+
+  fourzone_lighting_remove();
+  fourzone_leds_remove();
+  if (kbd_backlight_registered) {
+    led_classdev_unregister(&kbd_backlight);
+    kbd_backlight_registered = false;
+  }
+  cancel_work_sync(&kbd_backlight_work);
+
+  mutex_lock(&effect_lock);
+  WRITE_ONCE(effect_mode, FOURZONE_EFFECT_NONE);
+  mutex_unlock(&effect_lock);
+  cancel_delayed_work_sync(&effect_work);
+  flush_work(&fourzone_flush_work);
+
+  fourzone_free();
+}
+
+/*
+ * Setup stages
+ *
+ * Everything depends on the capability probe, so it runs synchronously
+ * at module init, and probe itself only creates the plain sysfs
+ * attributes. The rest of the firmware setup runs as one async stage
+ * per feature, so input, rfkill, lighting, sensor and thermal setup
+ * overlap and none of them holds up the driver core. Each stage records
+ * how long it took, see init_times in debugfs.
+ */
+struct hp_wmi_stage {
+  const char *name;
+  int (*setup)(struct platform_device *device);
+  struct platform_device *device;
+  u64 ns;
   int err;
+  bool done;
+};
+
+enum hp_wmi_stage_id {
+  HPWMI_STAGE_CAPS,
+  HPWMI_STAGE_INPUT,
+  HPWMI_STAGE_SYSFS,
+  HPWMI_STAGE_RFKILL,
+  HPWMI_STAGE_LIGHTING,
+  HPWMI_STAGE_SENSORS,
+  HPWMI_STAGE_THERMAL,
+  HPWMI_STAGE_COUNT
+};
+
+/*
+ * Registered rather than exclusive, so the module loader's
+ * async_synchronize_full() waits for the stages unless async_probe is set
+ */
+static ASYNC_DOMAIN(hp_wmi_async);
+
+static int hp_wmi_input_stage(struct platform_device *device)
+{
+  int err = hp_wmi_input_setup();
+
+  if (err) {
+    hp_wmi_input_dev = NULL;
+    return err;
+  }
+
+  hp_wmi_events_setup();
+  return 0;
+}
+
+static int hp_wmi_sysfs_setup(struct platform_device *device)
+{
+  return sysfs_create_group(&device->dev.kobj, &hp_wmi_group);
+}
 
+static int hp_wmi_rfkill_stage(struct platform_device *device)
+{
   /* clear detected rfkill devices */
   wifi_rfkill = NULL;
   bluetooth_rfkill = NULL;
@@ -1143,101 +4092,260 @@ static int __init hp_wmi_bios_setup(struct platform_device *device)
   rfkill2_count = 0;
 
   if (hp_wmi_rfkill_setup(device))
-    hp_wmi_rfkill2_setup(device);
+    return hp_wmi_rfkill2_setup(device);
+  return 0;
+}
+
+static int hp_wmi_sensors_stage(struct platform_device *device)
+{
+  if (quirks->fan_control) {
+    hp_wmi_hwmon_setup(device);
+    fan_max_setup(device);
+  }
+  return 0;
+}
 
-  fourzone_setup(device);
+static int hp_wmi_thermal_stage(struct platform_device *device)
+{
+  if (quirks->thermal_modes) {
+    omen_design_data_setup();
+    omen_profile_setup();
+    omen_power_setup(device);
+  }
+  return 0;
+}
 
-  err = device_create_file(&device->dev, &dev_attr_display);
-  if (err)
-    goto add_sysfs_error;
-  err = device_create_file(&device->dev, &dev_attr_hddtemp);
-  if (err)
-    goto add_sysfs_error;
-  err = device_create_file(&device->dev, &dev_attr_als);
-  if (err)
-    goto add_sysfs_error;
-  err = device_create_file(&device->dev, &dev_attr_dock);
-  if (err)
-    goto add_sysfs_error;
-  err = device_create_file(&device->dev, &dev_attr_tablet);
-  if (err)
-    goto add_sysfs_error;
-  err = device_create_file(&device->dev, &dev_attr_postcode);
-  if (err)
-    goto add_sysfs_error;
+static struct hp_wmi_stage hp_wmi_stages[HPWMI_STAGE_COUNT] = {
+  [HPWMI_STAGE_CAPS] = { "caps", hp_wmi_caps_probe },
+  [HPWMI_STAGE_INPUT] = { "input", hp_wmi_input_stage },
+  [HPWMI_STAGE_SYSFS] = { "sysfs", hp_wmi_sysfs_setup },
+  [HPWMI_STAGE_RFKILL] = { "rfkill", hp_wmi_rfkill_stage },
+  [HPWMI_STAGE_LIGHTING] = { "lighting", fourzone_setup },
+  [HPWMI_STAGE_SENSORS] = { "sensors", hp_wmi_sensors_stage },
+  [HPWMI_STAGE_THERMAL] = { "thermal", hp_wmi_thermal_stage },
+};
+
+static int hp_wmi_stage_run(struct hp_wmi_stage *stage)
+{
+  ktime_t start = ktime_get();
+
+  stage->err = stage->setup(stage->device);
+  stage->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+  stage->done = true;
+  pr_debug("%s setup took %lluus (%d)\n", stage->name,
+     div_u64(stage->ns, NSEC_PER_USEC), stage->err);
+  return stage->err;
+}
 
+static void hp_wmi_stage_fn(void *data, async_cookie_t cookie)
+{
+  hp_wmi_stage_run(data);
+}
+
+static void hp_wmi_stage_schedule(enum hp_wmi_stage_id id,
+          struct platform_device *device)
+{
+  hp_wmi_stages[id].device = device;
+  async_schedule_domain(hp_wmi_stage_fn, &hp_wmi_stages[id], &hp_wmi_async);
+}
+
+/* Waits for all stages still in flight */
+static void hp_wmi_stages_sync(void)
+{
+  async_synchronize_full_domain(&hp_wmi_async);
+}
+
+static int init_times_show(struct seq_file *m, void *unused)
+{
+  struct hp_wmi_stage *stage;
+
+  hp_wmi_stages_sync();
+  for (stage = hp_wmi_stages; stage < hp_wmi_stages + HPWMI_STAGE_COUNT; stage++) {
+    if (!stage->done)
+      continue;
+    seq_printf(m, "%s: %lluus", stage->name,
+         div_u64(stage->ns, NSEC_PER_USEC));
+    if (stage->err)
+      seq_printf(m, " (error %d)", stage->err);
+    seq_putc(m, '\n');
+  }
   return 0;
+}
 
-add_sysfs_error:
-  cleanup_sysfs(device);
-  return err;
+DEFINE_SHOW_ATTRIBUTE(init_times);
+
+/*
+ * The EC may lose the lighting across suspend, so the state buffer is
+ * saved here and written back as a whole at resume. Effects and queued
+ * colours are settled first, so no frame reaches the firmware while it
+ * is suspended.
+ */
+static u8 fourzone_saved[FOURZONE_STATE_SIZE];
+static bool fourzone_saved_valid;
+
+static void fourzone_suspend(void)
+{
+  /* LED triggers may still queue frames, they wait for resume */
+  WRITE_ONCE(fourzone_suspended, true);
+  cancel_delayed_work_sync(&effect_work);
+  flush_work(&fourzone_flush_work);
+  flush_work(&lighting_work);
+  flush_work(&kbd_backlight_work);
+
+  down_write(&fourzone_lock);
+  fourzone_saved_valid = !fourzone_refresh_state();
+  if (fourzone_saved_valid)
+    memcpy(fourzone_saved, fourzone_state, FOURZONE_STATE_SIZE);
+  up_write(&fourzone_lock);
 }
 
-static int __exit hp_wmi_bios_remove(struct platform_device *device)
+static void fourzone_resume(void)
 {
-  int i;
+  u8 *state;
+
+  down_write(&fourzone_lock);
+  fourzone_invalidate_state();
+  if (fourzone_saved_valid) {
+    state = fourzone_begin_state();
+    memcpy(state, fourzone_saved, FOURZONE_STATE_SIZE);
+    fourzone_commit_state(state);
+  } else {
+    fourzone_refresh_state();
+  }
+  up_write(&fourzone_lock);
+
+  /* Frames queued while suspended go on top of the restored state */
+  WRITE_ONCE(fourzone_suspended, false);
+  schedule_work(&fourzone_flush_work);
+  schedule_work(&lighting_work);
+  schedule_work(&kbd_backlight_work);
+
+  if (fourzone_effect_active())
+    mod_delayed_work(system_wq, &effect_work, 0);
+}
+
+static void hp_wmi_resume_fn(struct work_struct *work);
+static DECLARE_WORK(hp_wmi_resume_work, hp_wmi_resume_fn);
+
+static int hp_wmi_bios_setup(struct platform_device *device)
+{
+  int err;
+
+  hp_wmi_stages[HPWMI_STAGE_SYSFS].device = device;
+  err = hp_wmi_stage_run(&hp_wmi_stages[HPWMI_STAGE_SYSFS]);
+  if (err)
+    return err;
+
+  hp_wmi_stage_schedule(HPWMI_STAGE_RFKILL, device);
+  hp_wmi_stage_schedule(HPWMI_STAGE_LIGHTING, device);
+  hp_wmi_stage_schedule(HPWMI_STAGE_SENSORS, device);
+  hp_wmi_stage_schedule(HPWMI_STAGE_THERMAL, device);
+
+  return 0;
+}
+
+static int hp_wmi_bios_remove(struct platform_device *device)
+{
+  struct rfkill *wifi, *bluetooth, *wwan;
+  struct rfkill2_device radios[HPWMI_MAX_RFKILL2_DEVICES];
+  int count, i;
+
+  hp_wmi_stages_sync();
+  cancel_work_sync(&hp_wmi_resume_work);
   cleanup_sysfs(device);
+  hp_wmi_hwmon_remove();
+  omen_profile_remove();
+  omen_power_remove(device);
+  fan_max_remove(device);
+  fourzone_remove(device);
 
-  for (i = 0; i < rfkill2_count; i++) {
-    rfkill_unregister(rfkill2[i].rfkill);
-    rfkill_destroy(rfkill2[i].rfkill);
+  /*
+   * Detach the radios first so a wireless event handled from here on
+   * finds nothing to update. rfkill calls set_block with its own lock
+   * held, so they are unregistered after hp_wmi_wireless_lock is dropped.
+   */
+  mutex_lock(&hp_wmi_wireless_lock);
+  wifi = wifi_rfkill;
+  bluetooth = bluetooth_rfkill;
+  wwan = wwan_rfkill;
+  count = rfkill2_count;
+  memcpy(radios, rfkill2, sizeof(radios));
+  wifi_rfkill = NULL;
+  bluetooth_rfkill = NULL;
+  wwan_rfkill = NULL;
+  rfkill2_count = 0;
+  hp_wmi_wireless_state = -1;
+  mutex_unlock(&hp_wmi_wireless_lock);
+
+  for (i = 0; i < count; i++) {
+    rfkill_unregister(radios[i].rfkill);
+    rfkill_destroy(radios[i].rfkill);
   }
 
-  if (wifi_rfkill) {
-    rfkill_unregister(wifi_rfkill);
-    rfkill_destroy(wifi_rfkill);
+  if (wifi) {
+    rfkill_unregister(wifi);
+    rfkill_destroy(wifi);
   }
-  if (bluetooth_rfkill) {
-    rfkill_unregister(bluetooth_rfkill);
-    rfkill_destroy(bluetooth_rfkill);
+  if (bluetooth) {
+    rfkill_unregister(bluetooth);
+    rfkill_destroy(bluetooth);
   }
-  if (wwan_rfkill) {
-    rfkill_unregister(wwan_rfkill);
-    rfkill_destroy(wwan_rfkill);
+  if (wwan) {
+    rfkill_unregister(wwan);
+    rfkill_destroy(wwan);
   }
 
   return 0;
 }
 
-static int hp_wmi_resume_handler(struct device *device)
+/*
+ * Resume only queues hp_wmi_resume_work, so the firmware calls below stay
+ * off the device resume path. Every state is refreshed from one query:
+ * dock and tablet share a HARDWARE_QUERY, the radios one wireless
+ * snapshot, and the keyboard gets its saved colours back in one SET.
+ */
+static void hp_wmi_resume_fn(struct work_struct *work)
 {
+  hp_wmi_stages_sync();
+  hp_wmi_status_invalidate_all();
+
   /*
    * Hardware state may have changed while suspended, so trigger
    * input events for the current state. As this is a switch,
    * the input layer will only actually pass it on if the state
    * changed.
    */
-  if (hp_wmi_input_dev) {
-    if (test_bit(SW_DOCK, hp_wmi_input_dev->swbit))
-      input_report_switch(hp_wmi_input_dev, SW_DOCK,
-              hp_wmi_hw_state(HPWMI_DOCK_MASK));
-    if (test_bit(SW_TABLET_MODE, hp_wmi_input_dev->swbit))
-      input_report_switch(hp_wmi_input_dev, SW_TABLET_MODE,
-              hp_wmi_hw_state(HPWMI_TABLET_MASK));
-    input_sync(hp_wmi_input_dev);
-  }
+  if (hp_wmi_input_dev)
+    hp_wmi_report_hw_state();
 
-  if (rfkill2_count)
-    hp_wmi_rfkill2_refresh();
+  hp_wmi_wireless_refresh();
 
-  if (wifi_rfkill)
-    rfkill_set_states(wifi_rfkill,
-          hp_wmi_get_sw_state(HPWMI_WIFI),
-          hp_wmi_get_hw_state(HPWMI_WIFI));
-  if (bluetooth_rfkill)
-    rfkill_set_states(bluetooth_rfkill,
-          hp_wmi_get_sw_state(HPWMI_BLUETOOTH),
-          hp_wmi_get_hw_state(HPWMI_BLUETOOTH));
-  if (wwan_rfkill)
-    rfkill_set_states(wwan_rfkill,
-          hp_wmi_get_sw_state(HPWMI_WWAN),
-          hp_wmi_get_hw_state(HPWMI_WWAN));
+  if (quirks->fourzone && zone_data)
+    fourzone_resume();
+}
+
+static int hp_wmi_suspend_handler(struct device *device)
+{
+  hp_wmi_stages_sync();
+  cancel_work_sync(&hp_wmi_resume_work);
+
+  if (quirks->fourzone && zone_data)
+    fourzone_suspend();
 
   return 0;
 }
 
+static int hp_wmi_resume_handler(struct device *device)
+{
+  schedule_work(&hp_wmi_resume_work);
+  return 0;
+}
+
 static const struct dev_pm_ops hp_wmi_pm_ops = {
+  .suspend  = hp_wmi_suspend_handler,
   .resume  = hp_wmi_resume_handler,
+  .freeze  = hp_wmi_suspend_handler,
+  .thaw  = hp_wmi_resume_handler,
   .restore  = hp_wmi_resume_handler,
 };
 
@@ -1245,8 +4353,12 @@ static struct platform_driver hp_wmi_driver = {
   .driver = {
     .name = "hp-wmi",
     .pm = &hp_wmi_pm_ops,
+    .probe_type = PROBE_PREFER_ASYNCHRONOUS,
+    /* As platform_driver_probe() did: the input side outlives an unbind */
+    .suppress_bind_attrs = true,
   },
-  .remove = __exit_p(hp_wmi_bios_remove),
+  .probe = hp_wmi_bios_setup,
+  .remove = hp_wmi_bios_remove,
 };
 
 static int __init hp_wmi_init(void)
@@ -1258,32 +4370,43 @@ static int __init hp_wmi_init(void)
   if (!bios_capable && !event_capable)
     return -ENODEV;
 
-  if (event_capable) {
-    err = hp_wmi_input_setup();
-    if (err)
-      return err;
-  }
+  hp_wmi_status_init();
+  hp_wmi_quirks_setup();
+  hp_wmi_debugfs_init();
+  debugfs_create_file("init_times", 0444, hp_wmi_debugfs, NULL,
+          &init_times_fops);
+  debugfs_create_file("caps", 0444, hp_wmi_debugfs, NULL, &caps_fops);
+
+  /* Everything after this relies on the capability bitmap */
+  if (bios_capable)
+    hp_wmi_stage_run(&hp_wmi_stages[HPWMI_STAGE_CAPS]);
+
+  if (event_capable)
+    hp_wmi_stage_schedule(HPWMI_STAGE_INPUT, NULL);
 
   if (bios_capable) {
+    err = platform_driver_register(&hp_wmi_driver);
+    if (err)
+      goto err_sync;
+
     hp_wmi_platform_dev =
       platform_device_register_simple("hp-wmi", -1, NULL, 0);
     if (IS_ERR(hp_wmi_platform_dev)) {
       err = PTR_ERR(hp_wmi_platform_dev);
-      goto err_destroy_input;
+      hp_wmi_platform_dev = NULL;
+      goto err_unregister_driver;
     }
-
-    err = platform_driver_probe(&hp_wmi_driver, hp_wmi_bios_setup);
-    if (err)
-      goto err_unregister_device;
   }
 
   return 0;
 
-err_unregister_device:
-  platform_device_unregister(hp_wmi_platform_dev);
-err_destroy_input:
-  if (event_capable)
+err_unregister_driver:
+  platform_driver_unregister(&hp_wmi_driver);
+err_sync:
+  hp_wmi_stages_sync();
+  if (hp_wmi_input_dev)
     hp_wmi_input_destroy();
+  hp_wmi_debugfs_exit();
 
   return err;
 }
@@ -1291,12 +4414,15 @@ module_init(hp_wmi_init);
 
 static void __exit hp_wmi_exit(void)
 {
-  if (wmi_has_guid(HPWMI_EVENT_GUID))
+  hp_wmi_stages_sync();
+  if (hp_wmi_input_dev)
     hp_wmi_input_destroy();
 
   if (hp_wmi_platform_dev) {
     platform_device_unregister(hp_wmi_platform_dev);
     platform_driver_unregister(&hp_wmi_driver);
   }
+
+  hp_wmi_debugfs_exit();
 }
 module_exit(hp_wmi_exit);